@@ -16,11 +16,17 @@
  *
  */
 
+#define _DEFAULT_SOURCE   // For mkstemp
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <check.h>
 #include "mm.h"
+#include "mm_handle.h"
 
 /* Choose which malloc/free to test */
 #define MALLOC simple_malloc
@@ -337,6 +343,403 @@ START_TEST (test_first_fit_strategy)
 // This test should fail since we use a next fit strategy.
 END_TEST
 
+/**
+ * @name   Test heap statistics
+ * @brief  Verifies that simple_heap_stats tracks allocations, splits and coalescing.
+ */
+START_TEST (test_heap_stats)
+{
+  HeapStats before = simple_heap_stats();
+
+  void *ptr1 = simple_malloc(0x100);
+  void *ptr2 = simple_malloc(0x100);
+  ck_assert(ptr1 != NULL && ptr2 != NULL);
+
+  HeapStats s = simple_heap_stats();
+  ck_assert(s.allocs == before.allocs + 2);
+  ck_assert(s.used_blocks == before.used_blocks + 2);
+  ck_assert(s.bytes_in_use == before.bytes_in_use + 0x200);
+  ck_assert(s.largest_free <= s.bytes_free);
+  ck_assert(s.fragmentation >= 0.0 && s.fragmentation < 1.0);
+
+  // The histogram should account for every free block
+  size_t n = 0;
+  for (int i = 0; i < HEAP_STATS_BUCKETS; i++) {
+    n += s.free_histogram[i];
+  }
+  ck_assert(n == s.free_blocks);
+
+  simple_free(ptr1);
+  simple_free(ptr2);
+
+  s = simple_heap_stats();
+  ck_assert(s.frees == before.frees + 2);
+  ck_assert(s.used_blocks == before.used_blocks);
+  ck_assert(s.bytes_in_use == before.bytes_in_use);
+  ck_assert(s.coalesces > before.coalesces);
+}
+END_TEST
+
+/**
+ * @name   Test realloc
+ * @brief  Verifies that simple_realloc keeps the contents when growing a block.
+ */
+START_TEST (test_realloc)
+{
+  uint32_t *ptr = simple_malloc(16 * sizeof(uint32_t));
+  ck_assert(ptr != NULL);
+  for (uint32_t i = 0; i < 16; i++) ptr[i] = i * 0x01010101;
+
+  ptr = simple_realloc(ptr, 1024 * sizeof(uint32_t));
+  ck_assert(ptr != NULL);
+  for (uint32_t i = 0; i < 16; i++) ck_assert(ptr[i] == i * 0x01010101);
+
+  // Shrinking keeps the block
+  ck_assert(simple_realloc(ptr, 8) == ptr);
+
+  simple_free(ptr);
+}
+END_TEST
+
+/**
+ * @name   Test aligned allocation
+ * @brief  Verifies that simple_memalign returns aligned, non-overlapping blocks
+ *         and that the leading padding is given back as free memory.
+ */
+START_TEST (test_memalign)
+{
+  size_t aligns[] = { 8, 16, 32, 64, 4096 };
+  void *ptrs[5];
+
+  for (int i = 0; i < 5; i++) {
+    ptrs[i] = simple_memalign(aligns[i], 100);
+    ck_assert(ptrs[i] != NULL);
+    ck_assert(((uintptr_t) ptrs[i] & (aligns[i] - 1)) == 0);
+    memset(ptrs[i], i, 100);
+  }
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 100; j++) ck_assert(((uint8_t *) ptrs[i])[j] == i);
+  }
+
+  HeapStats s = simple_heap_stats();
+  for (int i = 0; i < 5; i++) simple_free(ptrs[i]);
+  ck_assert(simple_heap_stats().used_blocks == s.used_blocks - 5);
+
+  ck_assert(simple_memalign(24, 100) == NULL);         // Not a power of two
+  ck_assert(simple_aligned_alloc(64, 100) == NULL);    // Size not a multiple of align
+  void *ptr = simple_aligned_alloc(64, 128);
+  ck_assert(ptr != NULL && ((uintptr_t) ptr & 63) == 0);
+  simple_free(ptr);
+}
+END_TEST
+
+/**
+ * @name   Test calloc
+ * @brief  Verifies that simple_calloc returns zeroed memory, also when reusing a dirty block.
+ */
+START_TEST (test_calloc)
+{
+  uint8_t *ptr = simple_calloc(100, 10);
+  ck_assert(ptr != NULL);
+  for (int i = 0; i < 1000; i++) ck_assert(ptr[i] == 0);
+
+  memset(ptr, 0xFF, 1000);
+  simple_free(ptr);
+
+  // The same block may be handed out again; it must still come back cleared
+  ptr = simple_calloc(1000, 1);
+  ck_assert(ptr != NULL);
+  for (int i = 0; i < 1000; i++) ck_assert(ptr[i] == 0);
+  simple_free(ptr);
+
+  ck_assert(simple_calloc(SIZE_MAX / 2, 4) == NULL);   // Overflow
+}
+END_TEST
+
+/**
+ * @name   Test batch allocation
+ * @brief  Verifies that a batch is carved as distinct blocks and freed again in one call.
+ */
+START_TEST (test_batch)
+{
+  void *ptrs[101];
+  HeapStats before = simple_heap_stats();
+
+  ck_assert(simple_malloc_batch(40, 100, ptrs) == 100);
+  for (int i = 0; i < 100; i++) memset(ptrs[i], i, 40);
+  for (int i = 0; i < 100; i++) {
+    for (int j = 0; j < 40; j++) ck_assert(((uint8_t *) ptrs[i])[j] == i);
+  }
+
+  // Free in scrambled order; the batch free sorts them
+  for (int i = 0; i < 100; i += 2) {
+    void *tmp = ptrs[i];
+    ptrs[i] = ptrs[99 - i];
+    ptrs[99 - i] = tmp;
+  }
+  // A pointer into the middle of a block is skipped, and the rest still freed
+  ptrs[100] = (uint8_t *) ptrs[50] + 16;
+  simple_free_batch(ptrs, 101);
+
+  HeapStats s = simple_heap_stats();
+  ck_assert(s.used_blocks == before.used_blocks);
+  ck_assert(s.allocs == before.allocs + 100);
+  ck_assert(s.frees == before.frees + 100);
+}
+END_TEST
+
+/**
+ * @name   Test size-class pages
+ * @brief  Verifies that small objects are packed without headers into size-class pages.
+ */
+START_TEST (test_small_objects)
+{
+  void *ptrs[200];
+
+  simple_small_objects(1);
+  for (int i = 0; i < 200; i++) {
+    ptrs[i] = simple_malloc(8);
+    ck_assert(ptrs[i] != NULL);
+    memset(ptrs[i], i, 8);
+  }
+
+  HeapStats s = simple_heap_stats();
+  ck_assert(s.small_objects >= 200);
+  ck_assert(s.small_pages >= 1);
+
+  // Objects of one class are packed back to back
+  ck_assert((uint8_t *) ptrs[1] - (uint8_t *) ptrs[0] == 8);
+  ck_assert(simple_usable_size(ptrs[0]) == 8);
+
+  for (int i = 0; i < 200; i++) {
+    for (int j = 0; j < 8; j++) ck_assert(((uint8_t *) ptrs[i])[j] == i);
+  }
+
+  // Growing past the class moves the object out of the page
+  void *big = simple_realloc(ptrs[0], 1000);
+  ck_assert(big != NULL && ((uint8_t *) big)[7] == 0);
+  simple_free(big);
+
+  // Batches of small sizes come from the size classes too
+  void *batch[10];
+  size_t objects = simple_heap_stats().small_objects;
+  ck_assert(simple_malloc_batch(16, 10, batch) == 10);
+  ck_assert(simple_heap_stats().small_objects == objects + 10);
+  simple_free_batch(batch, 10);
+  ck_assert(simple_heap_stats().small_objects == objects);
+
+  for (int i = 1; i < 200; i++) simple_free(ptrs[i]);
+  simple_small_objects(0);
+
+  ck_assert(simple_heap_stats().small_objects == s.small_objects - 200);
+
+  // Pages take less heap per object than headered blocks, alignment holes included
+  static void *many[4000];
+  double per_object[2];
+  for (int small = 0; small < 2; small++) {
+    uintptr_t lo = UINTPTR_MAX, hi = 0;
+    simple_small_objects(small);
+    for (int i = 0; i < 4000; i++) {
+      many[i] = simple_malloc(8);
+      ck_assert(many[i] != NULL);
+      if ((uintptr_t) many[i] < lo) lo = (uintptr_t) many[i];
+      if ((uintptr_t) many[i] > hi) hi = (uintptr_t) many[i];
+    }
+    per_object[small] = (double) (hi - lo) / 4000;
+    for (int i = 0; i < 4000; i++) simple_free(many[i]);
+  }
+  simple_small_objects(0);
+  ck_assert(per_object[1] < per_object[0]);
+
+  // A heap small enough that the page bitmap itself is a small request; needs a fresh process
+  pid_t pid = fork();
+  if (pid == 0) {
+    execl("/proc/self/exe", "check_mm", "small-heap", (char *) NULL);
+    _exit(127);
+  }
+  int status;
+  ck_assert(waitpid(pid, &status, 0) == pid);
+  ck_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+END_TEST
+
+/**
+ * @name   Small objects on a small heap
+ * @brief  Run by test_small_objects in a process of its own, as the heap can only be set up once.
+ */
+static int small_heap(void)
+{
+  if (simple_heap_hugepages(2 * 1024 * 1024) < 0) return 2;
+
+  simple_small_objects(1);
+  void *ptr = simple_malloc(8);
+  if (ptr == NULL || simple_heap_stats().small_objects != 1) return 1;
+  simple_free(ptr);
+  return 0;
+}
+
+/**
+ * @name   Test best-fit placement
+ * @brief  Verifies that best-fit takes the smallest free block that fits.
+ */
+START_TEST (test_best_fit)
+{
+  size_t sizes[3] = { 512, 128, 256 };
+  void *holes[3], *guards[3];
+
+  simple_best_fit(1);
+
+  // Three free blocks of different sizes, kept apart by allocated blocks
+  for (int i = 0; i < 3; i++) {
+    holes[i] = simple_malloc(sizes[i]);
+    guards[i] = simple_malloc(64);
+    ck_assert(holes[i] != NULL && guards[i] != NULL);
+  }
+  for (int i = 0; i < 3; i++) simple_free(holes[i]);
+
+  void *a = simple_malloc(100);
+  void *b = simple_malloc(200);
+  void *c = simple_malloc(500);
+  ck_assert(a == holes[1]);
+  ck_assert(b == holes[2]);
+  ck_assert(c == holes[0]);
+
+  simple_free(a);
+  simple_free(b);
+  simple_free(c);
+  for (int i = 0; i < 3; i++) simple_free(guards[i]);
+  simple_best_fit(0);
+}
+END_TEST
+
+/**
+ * @name   Test deferred coalescing
+ * @brief  Verifies that freed blocks are reused by size from the quick lists and
+ *         merged again when the lists are swept.
+ */
+START_TEST (test_deferred_coalescing)
+{
+  void *ptrs[10];
+
+  simple_deferred_coalescing(1);
+  for (int i = 0; i < 10; i++) ptrs[i] = simple_malloc(100);
+  HeapStats before = simple_heap_stats();
+
+  for (int i = 0; i < 10; i++) simple_free(ptrs[i]);
+  HeapStats s = simple_heap_stats();
+  ck_assert(s.deferred_blocks == before.deferred_blocks + 10);
+  ck_assert(s.coalesces == before.coalesces);
+
+  // Same size comes straight back off the quick list, without splitting
+  void *again = simple_malloc(100);
+  ck_assert(again == ptrs[9]);
+  ck_assert(simple_heap_stats().splits == before.splits);
+  simple_free(again);
+
+  // Disabling sweeps the quick lists back into the heap
+  simple_deferred_coalescing(0);
+  s = simple_heap_stats();
+  ck_assert(s.deferred_blocks == 0);
+  ck_assert(s.sweeps == before.sweeps + 1);
+  ck_assert(s.coalesces > before.coalesces);
+
+  // A batch merges the quick lists back when they hold the only room left
+  static void *fill[4096];
+  size_t filled = 0;
+  void *batch[4];
+
+  simple_deferred_coalescing(1);
+  for (int i = 0; i < 10; i++) ptrs[i] = simple_malloc(100);
+  while (filled < 4096 && (s = simple_heap_stats()).largest_free >= 200) {
+    fill[filled] = simple_malloc(s.largest_free - 8);
+    ck_assert(fill[filled++] != NULL);
+  }
+  for (int i = 0; i < 10; i++) simple_free(ptrs[i]);
+
+  ck_assert(simple_malloc_batch(200, 4, batch) == 4);
+  ck_assert(simple_heap_stats().deferred_blocks == 0);
+
+  simple_free_batch(batch, 4);
+  simple_free_batch(fill, filled);
+  simple_deferred_coalescing(0);
+}
+END_TEST
+
+/**
+ * @name   Test handle compaction
+ * @brief  Verifies that compaction moves unlocked handle blocks together, keeping their
+ *         contents, and leaves locked blocks in place.
+ */
+START_TEST (test_handles)
+{
+  Handle h[20];
+
+  for (int i = 0; i < 20; i++) {
+    h[i] = hmalloc(200);
+    ck_assert(h[i] != 0);
+    memset(hlock(h[i]), i, 200);
+    hunlock(h[i]);
+  }
+  for (int i = 0; i < 20; i += 2) hfree(h[i]);
+  ck_assert(hlock(h[0]) == NULL);   // Freed handles are invalid
+
+  void *pinned = hlock(h[11]);
+  CompactStats c = hcompact(SIZE_MAX);
+  ck_assert(c.moved_blocks > 0);
+  ck_assert(c.moved_bytes >= c.moved_blocks * 200);
+  ck_assert(c.free_blocks_after < c.free_blocks_before);
+  ck_assert(hlock(h[11]) == pinned);
+  hunlock(h[11]);
+  hunlock(h[11]);
+
+  for (int i = 1; i < 20; i += 2) {
+    uint8_t *p = hlock(h[i]);
+    for (int j = 0; j < 200; j++) ck_assert(p[j] == i);
+    hunlock(h[i]);
+    hfree(h[i]);
+  }
+}
+END_TEST
+
+/**
+ * @name   Test heap profiler
+ * @brief  Verifies that sampled allocations show up in the live and total counts of
+ *         the profile, and leave the live counts when freed.
+ */
+START_TEST (test_profile)
+{
+  char path[] = "/tmp/mm_profile_XXXXXX";
+  unsigned long live_count, live_bytes, total_count, total_bytes;
+  void *ptrs[10];
+
+  int fd = mkstemp(path);
+  ck_assert(fd >= 0);
+
+  simple_profile(path, 1);   // Sample every allocation
+  for (int i = 0; i < 10; i++) ptrs[i] = simple_malloc(1000);
+
+  ck_assert(simple_profile_dump(NULL) == 0);
+  FILE *f = fdopen(fd, "r");
+  ck_assert(fscanf(f, "heap profile: %lu: %lu [%lu: %lu]", &live_count, &live_bytes, &total_count, &total_bytes) == 4);
+  ck_assert(live_count == 10 && live_bytes == 10000);
+  ck_assert(total_count == 10);
+
+  // Samples freed after profiling was stopped leave the live totals too
+  for (int i = 0; i < 5; i++) simple_free(ptrs[i]);
+  simple_profile(NULL, 0);
+  for (int i = 5; i < 10; i++) simple_free(ptrs[i]);
+
+  ck_assert(simple_profile_dump(path) == 0);
+  rewind(f);
+  ck_assert(fscanf(f, "heap profile: %lu: %lu [%lu: %lu]", &live_count, &live_bytes, &total_count, &total_bytes) == 4);
+  ck_assert(live_count == 0 && live_bytes == 0);
+  ck_assert(total_count == 10 && total_bytes == 10000);
+
+  fclose(f);
+  unlink(path);
+}
+END_TEST
+
 /**
  * { You may provide more unit tests here, but remember to add them to simple_malloc_suite }
  */
@@ -357,6 +760,16 @@ Suite* simple_malloc_suite()
   tcase_add_test(tc_core, test_memory_exerciser);
   tcase_add_test(tc_core, test_next_fit_strategy);
   tcase_add_test(tc_core, test_first_fit_strategy);
+  tcase_add_test(tc_core, test_heap_stats);
+  tcase_add_test(tc_core, test_realloc);
+  tcase_add_test(tc_core, test_memalign);
+  tcase_add_test(tc_core, test_calloc);
+  tcase_add_test(tc_core, test_batch);
+  tcase_add_test(tc_core, test_small_objects);
+  tcase_add_test(tc_core, test_best_fit);
+  tcase_add_test(tc_core, test_deferred_coalescing);
+  tcase_add_test(tc_core, test_handles);
+  tcase_add_test(tc_core, test_profile);
 
   suite_add_tcase(s, tc_core);
   return s;
@@ -371,8 +784,10 @@ Suite* simple_malloc_suite()
  * If you organize your tests in multiple test suites, remember
  * to add the new suites to this function.
  */
-int main()
+int main(int argc, char **argv)
 {
+  if (argc > 1 && strcmp(argv[1], "small-heap") == 0) return small_heap();
+
   int number_failed;
   Suite *s = simple_malloc_suite();
   SRunner *sr = srunner_create(s);
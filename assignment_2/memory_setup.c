@@ -7,8 +7,21 @@
 * This file contains low level initialization of memory. You should
  * not need to edit this file as part of the assignment.
  *
+ * By default the heap is a static array. memory_setup_file() replaces it
+ * with a file mapped at a fixed address, so that a later process can map the
+ * same file at the same address and find all pointers in it still valid.
+ * memory_setup_huge() replaces it with an anonymous region backed by 2 MB
+ * pages where the system provides them.
  */
 
+#define _DEFAULT_SOURCE   // For MAP_FIXED_NOREPLACE
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "mm.h"
 
 #define ALLOCATE_SIZE    32*1024*1024                 // 32 MB
@@ -17,5 +30,143 @@
 static int8_t skew[SKEW_SIZE];                        // Misalignment
 static int8_t memory[ALLOCATE_SIZE];
 
-const uintptr_t memory_start =  (uintptr_t) memory;
-const uintptr_t memory_end   =  (uintptr_t) memory + ALLOCATE_SIZE;
+uintptr_t memory_start =  (uintptr_t) memory;
+uintptr_t memory_end   =  (uintptr_t) memory + ALLOCATE_SIZE;
+int memory_file_backed = 0;
+size_t memory_page_size = 4096;
+
+
+#define MEMORY_FILE_MAGIC   "SMHEAP1"
+#define MEMORY_FILE_BASE    0x100000000000ul          // Preferred address of new heap files
+#define HUGE_PAGE_SIZE      (2 * 1024 * 1024)
+
+/* Header at the start of a heap file, in front of the heap region */
+typedef struct {
+  char     magic[8];    // MEMORY_FILE_MAGIC
+  uint64_t base;        // Address the file must be mapped at
+  uint64_t size;        // Size of the file
+  void *   root;        // Root object, see simple_heap_root
+  uint64_t reserved[4];
+} MemoryFileHeader;
+
+static MemoryFileHeader *file_header = NULL;
+
+
+/* Maps size bytes of fd at addr without replacing existing mappings */
+static void * map_fixed(int fd, uintptr_t addr, size_t size) {
+  void *p = mmap((void *) addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+  if (p != MAP_FAILED && p != (void *) addr) {
+    munmap(p, size);   // Kernels before 4.17 take the address as a hint only
+    p = MAP_FAILED;
+  }
+  return p;
+}
+
+
+/**
+ * @name    memory_setup_file
+ * @brief   Makes the file at path the heap region. An existing heap file is mapped at
+ *          the address it was created at and size is ignored; otherwise a new file of
+ *          size bytes is created.
+ * @retval  0 if ok, -1 if the file could not be created or mapped at its address.
+ */
+int memory_setup_file(const char *path, size_t size) {
+  MemoryFileHeader header;
+  struct stat st;
+  void *p = MAP_FAILED;
+
+  if (memory_start != (uintptr_t) memory) return -1;   // Region already replaced
+
+  int fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) return -1;
+
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    // Existing heap: it must go back at the same address
+    if (pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+        memcmp(header.magic, MEMORY_FILE_MAGIC, sizeof(header.magic)) == 0 &&
+        header.size == (uint64_t) st.st_size) {
+      p = map_fixed(fd, header.base, header.size);
+    }
+  } else {
+    size = (size + 4095) & ~(size_t) 4095;
+    if (size >= 2 * sizeof(header) && ftruncate(fd, size) == 0) {
+      p = map_fixed(fd, MEMORY_FILE_BASE, size);
+      if (p == MAP_FAILED) p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+      if (p != MAP_FAILED) {
+        MemoryFileHeader *h = p;
+        memcpy(h->magic, MEMORY_FILE_MAGIC, sizeof(h->magic));
+        h->base = (uintptr_t) p;
+        h->size = size;
+      }
+    }
+  }
+  close(fd);   // The mapping keeps the file open
+
+  if (p == MAP_FAILED) return -1;
+
+  file_header = p;
+  memory_start = (uintptr_t) p + sizeof(MemoryFileHeader);
+  memory_end = (uintptr_t) p + file_header->size;
+  memory_file_backed = 1;
+  return 0;
+}
+
+
+/**
+ * @name    memory_setup_huge
+ * @brief   Makes a new anonymous region of size bytes (rounded up to 2 MB), aligned to
+ *          2 MB, the heap region. Reserved hugetlb pages are used if there are enough,
+ *          otherwise transparent hugepages are requested with madvise.
+ * @retval  2 if backed by hugetlb pages, 1 if transparent hugepages were requested,
+ *          0 if only normal pages are available, -1 if the region could not be mapped.
+ */
+int memory_setup_huge(size_t size) {
+  int ret = 2;
+
+  if (memory_start != (uintptr_t) memory) return -1;   // Region already replaced
+
+  size = (size + HUGE_PAGE_SIZE - 1) & ~(size_t) (HUGE_PAGE_SIZE - 1);
+  if (size == 0) return -1;
+
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p == MAP_FAILED) {
+    // Map a little more than needed and trim it to a 2 MB aligned region
+    uintptr_t q = (uintptr_t) mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ((void *) q == MAP_FAILED) return -1;
+
+    uintptr_t aligned = (q + HUGE_PAGE_SIZE - 1) & ~(uintptr_t) (HUGE_PAGE_SIZE - 1);
+    if (aligned > q) munmap((void *) q, aligned - q);
+    if (q + HUGE_PAGE_SIZE > aligned) munmap((void *) (aligned + size), q + HUGE_PAGE_SIZE - aligned);
+
+    p = (void *) aligned;
+    ret = madvise(p, size, MADV_HUGEPAGE) == 0 ? 1 : 0;
+  }
+
+  memory_start = (uintptr_t) p;
+  memory_end = (uintptr_t) p + size;
+  if (ret > 0) memory_page_size = HUGE_PAGE_SIZE;
+  return ret;
+}
+
+
+/**
+ * @name    memory_sync
+ * @brief   Writes the heap file back to disk.
+ * @retval  0 if ok or the heap is not file backed, -1 on error.
+ */
+int memory_sync(void) {
+  if (file_header == NULL) return 0;
+  return msync(file_header, file_header->size, MS_SYNC);
+}
+
+
+void * simple_heap_root(void) {
+  return file_header != NULL ? file_header->root : NULL;
+}
+
+
+void simple_heap_set_root(void *ptr) {
+  if (file_header != NULL) file_header->root = ptr;
+}
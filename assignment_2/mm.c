@@ -6,9 +6,17 @@
  *
  */
 
+#define _DEFAULT_SOURCE   // For madvise
+
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 
 #include "mm.h"
+#include "mm_prof.h"
+#include "mm_small.h"
+#include "mm_trace.h"
 
 
 
@@ -35,10 +43,302 @@ typedef struct header {
 
 #define MIN_SIZE     (8)   // A block should have at least 8 bytes available for the user
 
+/* Reports an allocation or a free to the trace recorder and the heap profiler */
+#define RECORD_MALLOC(ptr, size) \
+    do { if (trace_enabled) trace_record(TRACE_MALLOC, ptr, size); PROF_MALLOC(ptr, size); } while (0)
+#define RECORD_FREE(ptr) \
+    do { if (trace_enabled) trace_record(TRACE_FREE, ptr, 0); PROF_FREE(ptr); } while (0)
+
+/* Node of the free tree, stored in the user block of a free block */
+typedef struct free_node {
+  struct free_node * left;
+  struct free_node * right;
+} FreeNode;
+
 
 BlockHeader *first = NULL;
 BlockHeader *current = NULL;
 BlockHeader *last = NULL;
+static BlockHeader *compact_cursor = NULL;   // Where simple_compact goes on; NULL for the front
+
+/* Heap statistics, kept up to date by simple_malloc/simple_free */
+static HeapStats stats;   // largest_free is read off the free tree by simple_heap_stats
+
+static int size_bucket(size_t size) {
+    int b = 63 - __builtin_clzll((unsigned long long) size | 1);
+    return b < HEAP_STATS_BUCKETS ? b : HEAP_STATS_BUCKETS - 1;
+}
+
+static void stats_free_add(size_t size) {
+    stats.bytes_free += size;
+    stats.free_blocks++;
+    stats.free_histogram[size_bucket(size)]++;
+}
+
+static void stats_free_remove(size_t size) {
+    stats.bytes_free -= size;
+    stats.free_blocks--;
+    stats.free_histogram[size_bucket(size)]--;
+}
+
+static void stats_used_add(size_t size) {
+    stats.bytes_in_use += size;
+    stats.used_blocks++;
+}
+
+static void stats_used_remove(size_t size) {
+    stats.bytes_in_use -= size;
+    stats.used_blocks--;
+}
+
+
+/*
+ * Known-zero page tracking for simple_calloc.
+ *
+ * One bit per page of the heap region, set when the page may hold non-zero data.
+ * The bitmap is stored at the start of the region, so it starts out all clear
+ * like the rest of the zero initialized memory. Pages are marked dirty when they
+ * are handed out to the user or a block header is written into them, and marked
+ * clean again when released to the kernel with MADV_DONTNEED.
+ */
+#define PAGE_SHIFT          12
+#define PAGE_SIZE           ((uintptr_t)1 << PAGE_SHIFT)
+#define RELEASE_THRESHOLD   (256 * 1024)   // Free blocks at least this large give their pages back
+
+static uint64_t *dirty_pages = NULL;
+static size_t num_pages = 0;
+static size_t newly_dirty = 0;     // Pages that turned dirty since the last release attempt
+
+static size_t page_of(uintptr_t addr) {
+    return (addr >> PAGE_SHIFT) - (memory_start >> PAGE_SHIFT);
+}
+
+static int page_dirty(size_t page) {
+    return (dirty_pages[page / 64] >> (page % 64)) & 1;
+}
+
+/* Sets (dirty = 1) or clears the bits of pages first..last */
+static void set_pages(size_t first_page, size_t last_page, int dirty) {
+    for (size_t page = first_page; page <= last_page; ) {
+        uint64_t mask = ~(uint64_t)0 << (page % 64);
+        if (last_page - page < 63 - page % 64) mask &= ~(uint64_t)0 >> (63 - last_page % 64);
+
+        if (dirty) {
+            newly_dirty += __builtin_popcountll(mask & ~dirty_pages[page / 64]);
+            dirty_pages[page / 64] |= mask;
+        } else {
+            dirty_pages[page / 64] &= ~mask;
+        }
+
+        page = (page | 63) + 1;
+    }
+}
+
+static void mark_dirty(void *addr, size_t len) {
+    if (dirty_pages == NULL || len == 0) return;
+    set_pages(page_of((uintptr_t)addr), page_of((uintptr_t)addr + len - 1), 1);
+}
+
+/* Zeroes the parts of [addr, addr+len) that lie in dirty pages */
+static void zero_dirty(void *addr, size_t len) {
+    uintptr_t p = (uintptr_t)addr, end = p + len;
+
+    while (p < end) {
+        uintptr_t page_end = (p | (PAGE_SIZE - 1)) + 1;
+        if (page_end > end) page_end = end;
+        if (page_dirty(page_of(p))) memset((void *)p, 0, page_end - p);
+        p = page_end;
+    }
+}
+
+/* Counts the dirty pages among pages first..last */
+static size_t count_dirty(size_t first_page, size_t last_page) {
+    size_t count = 0;
+
+    for (size_t page = first_page; page <= last_page; ) {
+        uint64_t mask = ~(uint64_t)0 << (page % 64);
+        if (last_page - page < 63 - page % 64) mask &= ~(uint64_t)0 >> (63 - last_page % 64);
+
+        count += __builtin_popcountll(dirty_pages[page / 64] & mask);
+        page = (page | 63) + 1;
+    }
+    return count;
+}
+
+/*
+ * Gives the dirty whole pages inside a large free block back to the kernel, which
+ * makes them zero. Nothing is done until enough pages have turned dirty since the
+ * last attempt, so that frees next to a large free block stay cheap.
+ */
+static void release_pages(BlockHeader *block) {
+    if (newly_dirty * PAGE_SIZE < RELEASE_THRESHOLD) return;
+
+    // Release whole pages of the region's page size, keeping the tree node of the block
+    uintptr_t unit = memory_page_size > PAGE_SIZE ? memory_page_size : PAGE_SIZE;
+    uintptr_t start = ((uintptr_t)block->user_block + sizeof(FreeNode) + unit - 1) & ~(unit - 1);
+    uintptr_t end = ((uintptr_t)block->user_block + SIZE(block)) & ~(unit - 1);
+
+    if (end <= start || end - start < RELEASE_THRESHOLD) return;
+
+    size_t first_page = page_of(start), last_page = page_of(end - 1);
+    size_t unit_pages = unit >> PAGE_SHIFT;
+    newly_dirty = 0;
+    if (count_dirty(first_page, last_page) * PAGE_SIZE < RELEASE_THRESHOLD) return;
+
+    // Release each run of dirty pages, widened to whole units
+    for (size_t page = first_page; page <= last_page; page++) {
+        if (!page_dirty(page)) continue;
+
+        size_t run_end = page;
+        while (run_end < last_page && page_dirty(run_end + 1)) run_end++;
+
+        page -= (page - first_page) % unit_pages;
+        run_end += unit_pages - 1 - (run_end - first_page) % unit_pages;
+
+        uintptr_t addr = start + ((page - first_page) << PAGE_SHIFT);
+        size_t len = (run_end - page + 1) << PAGE_SHIFT;
+        // Private pages are zero after MADV_DONTNEED, but file pages would be read back
+        // from the file, so those are punched out of the file with MADV_REMOVE instead
+        if (madvise((void *)addr, len, memory_file_backed ? MADV_REMOVE : MADV_DONTNEED) == 0) {
+            set_pages(page, run_end, 0);
+            stats.released_bytes += len;
+        }
+        page = run_end;
+    }
+}
+
+
+/*
+ * Free tree.
+ *
+ * The free blocks are also kept in a treap ordered by (size, address), so that
+ * the largest free block is known for the statistics and, when best-fit is
+ * enabled, the smallest block that fits is found in O(log n) expected time.
+ * The nodes live in the user blocks of the free blocks themselves, and the
+ * priority of a node is a hash of its address, so no extra space is needed.
+ * Free blocks too small to hold a node (MIN_SIZE bytes) are left out of the
+ * tree; they can still be reached by the next-fit search used when the tree
+ * has no fit.
+ */
+static int best_fit = 0;
+static FreeNode *tree_root = NULL;
+
+#define NODE_BLOCK(n)   ((BlockHeader *)((uintptr_t)(n) - sizeof(BlockHeader)))
+#define NODE_SIZE(n)    SIZE(NODE_BLOCK(n))
+
+static uint64_t node_priority(FreeNode *node) {
+    return ((uintptr_t)node >> 3) * 0x9E3779B97F4A7C15ull;
+}
+
+static int node_less(FreeNode *a, FreeNode *b) {
+    size_t size_a = NODE_SIZE(a), size_b = NODE_SIZE(b);
+    return size_a < size_b || (size_a == size_b && a < b);
+}
+
+static FreeNode *tree_insert(FreeNode *root, FreeNode *node) {
+    if (root == NULL) {
+        node->left = node->right = NULL;
+        return node;
+    }
+
+    if (node_less(node, root)) {
+        root->left = tree_insert(root->left, node);
+        if (node_priority(root->left) > node_priority(root)) {
+            FreeNode *top = root->left;   // Rotate right
+            root->left = top->right;
+            top->right = root;
+            root = top;
+        }
+    } else {
+        root->right = tree_insert(root->right, node);
+        if (node_priority(root->right) > node_priority(root)) {
+            FreeNode *top = root->right;  // Rotate left
+            root->right = top->left;
+            top->left = root;
+            root = top;
+        }
+    }
+    return root;
+}
+
+/* Joins two treaps where all nodes of a are less than all nodes of b */
+static FreeNode *tree_join(FreeNode *a, FreeNode *b) {
+    if (a == NULL) return b;
+    if (b == NULL) return a;
+
+    if (node_priority(a) > node_priority(b)) {
+        a->right = tree_join(a->right, b);
+        return a;
+    }
+    b->left = tree_join(a, b->left);
+    return b;
+}
+
+static FreeNode *tree_remove(FreeNode *root, FreeNode *node) {
+    if (root == NULL) return NULL;
+    if (root == node) return tree_join(root->left, root->right);
+
+    if (node_less(node, root)) root->left = tree_remove(root->left, node);
+    else root->right = tree_remove(root->right, node);
+    return root;
+}
+
+/* Finds the smallest free block with at least size bytes, or NULL if there is none */
+static BlockHeader *tree_best_fit(size_t size) {
+    FreeNode *best = NULL;
+
+    for (FreeNode *node = tree_root; node != NULL; ) {
+        if (NODE_SIZE(node) >= size) {
+            best = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return best ? NODE_BLOCK(best) : NULL;
+}
+
+/* Gives the size of the largest free block */
+static size_t tree_largest(void) {
+    FreeNode *node = tree_root;
+    if (node == NULL) return stats.free_blocks > 0 ? MIN_SIZE : 0;   // Only blocks too small for a node
+
+    while (node->right != NULL) node = node->right;
+    return NODE_SIZE(node);
+}
+
+/* Accounts for a new free block, adding it to the tree */
+static void free_insert(BlockHeader *block) {
+    stats_free_add(SIZE(block));
+    if (SIZE(block) >= sizeof(FreeNode)) {
+        mark_dirty(block->user_block, sizeof(FreeNode));
+        tree_root = tree_insert(tree_root, (FreeNode *)block->user_block);
+    }
+}
+
+/* Accounts for a free block about to be allocated or merged; must be called
+ * before its size changes */
+static void free_erase(BlockHeader *block) {
+    stats_free_remove(SIZE(block));
+    if (SIZE(block) >= sizeof(FreeNode)) {
+        tree_root = tree_remove(tree_root, (FreeNode *)block->user_block);
+    }
+}
+
+/**
+ * @name    attach_heap
+ * @brief   Rebuilds the statistics (and the free tree) for a heap that is already
+ *          laid out in the region, by walking its blocks.
+ */
+static void attach_heap(void) {
+    BlockHeader *p = first;
+
+    do {
+        if (GET_FREE(p)) free_insert(p);
+        else if (p != last) stats_used_add(SIZE(p));
+        p = GET_NEXT(p);
+    } while (p != first);
+}
 
 /**
  * @name    simple_init
@@ -49,90 +349,694 @@ void simple_init() {
     uintptr_t aligned_memory_start = (memory_start + 7) & ~0x7;  // Align to 8-byte boundary
     uintptr_t aligned_memory_end = memory_end & ~0x7;             // Align to 8-byte boundary
 
-    if (aligned_memory_start + 2 * sizeof(BlockHeader) + MIN_SIZE <= aligned_memory_end) {
-        first = (BlockHeader *)aligned_memory_start;
+    // Room for the dirty page bitmap at the start of the region
+    num_pages = page_of(memory_end - 1) + 1;
+    size_t bitmap_size = ((num_pages + 63) / 64) * sizeof(uint64_t);
+
+    if (aligned_memory_start + bitmap_size + 2 * sizeof(BlockHeader) + MIN_SIZE <= aligned_memory_end) {
+        dirty_pages = (uint64_t *)aligned_memory_start;
+        first = (BlockHeader *)(aligned_memory_start + bitmap_size);
         last = (BlockHeader *)(aligned_memory_end - sizeof(BlockHeader));  // Set global last
+        current = first;
+        trace_init();
+        prof_init();
+
+        if (memory_file_backed && first->next != NULL) {
+            // A heap file that was set up before; only the statistics are rebuilt
+            attach_heap();
+            return;
+        }
+
+        mark_dirty(first, sizeof(BlockHeader));
+        mark_dirty(last, sizeof(BlockHeader));
+
         SET_NEXT(first, last);
         SET_FREE(first, 1);
 
         SET_NEXT(last, first);  // Create circular link
         SET_FREE(last, 0);
 
-        current = first;
+        free_insert(first);
     }
 }
 
-void* simple_malloc(size_t size) {
+/**
+ * @name    split_block
+ * @brief   Splits a new free block off the end of block if more than aligned_size
+ *          bytes leaves enough space for it.
+ */
+static void split_block(BlockHeader *block, size_t aligned_size) {
+    if (SIZE(block) < aligned_size + sizeof(BlockHeader)) return;
+
+    size_t remaining_size = SIZE(block) - aligned_size - sizeof(BlockHeader);
+
+    if (remaining_size >= MIN_SIZE + sizeof(BlockHeader)) {
+        // Split the block if there's enough space left for a new block
+        BlockHeader *new_block = (BlockHeader *)((uintptr_t)block + sizeof(BlockHeader) + aligned_size);
+        mark_dirty(new_block, sizeof(BlockHeader));
+        SET_NEXT(new_block, GET_NEXT(block));
+        SET_FREE(new_block, 1);
+        SET_NEXT(block, new_block);
+        free_insert(new_block);
+        stats.splits++;
+    }
+}
+
+/*
+ * Deferred coalescing.
+ *
+ * When enabled, freed blocks of up to QUICK_MAX_SIZE bytes are not merged with
+ * their neighbours but pushed on a quick list for their exact size, linked
+ * through the first word of the user block. They stay marked as allocated in
+ * the block list, and an allocation of the same size pops one directly. All
+ * quick lists are merged back into the heap in a single sweep when an
+ * allocation would otherwise fail, or when the quick lists hold more than
+ * 1/QUICK_SWEEP_SHARE of the bytes in use (and at least QUICK_SWEEP_MIN bytes),
+ * as the blocks they hold fragment the heap for all other sizes.
+ */
+#define QUICK_MAX_SIZE      1024
+#define QUICK_LISTS         (QUICK_MAX_SIZE / 8)
+#define QUICK_SWEEP_MIN     (64 * 1024)
+#define QUICK_SWEEP_SHARE   16
+
+static int deferred = 0;
+static BlockHeader *quick[QUICK_LISTS];   // quick[i] holds blocks of size 8 * (i + 1)
+
+#define GET_LINK(p)     ((BlockHeader *)(uintptr_t)(p)->user_block[0])
+#define SET_LINK(p, n)  (p)->user_block[0] = (uintptr_t)(n)
+
+static void defer_block(BlockHeader *block) {
+    size_t size = SIZE(block);
+
+    SET_LINK(block, quick[size / 8 - 1]);
+    quick[size / 8 - 1] = block;
+
+    stats_used_remove(size);
+    stats.deferred_blocks++;
+    stats.deferred_bytes += size;
+    stats.frees++;
+}
+
+static BlockHeader *undefer_block(size_t size) {
+    BlockHeader *block = quick[size / 8 - 1];
+    if (block == NULL) return NULL;
+
+    quick[size / 8 - 1] = GET_LINK(block);
+
+    stats.deferred_blocks--;
+    stats.deferred_bytes -= size;
+    stats_used_add(size);
+    stats.allocs++;
+    return block;
+}
+
+/**
+ * @name    sweep_deferred
+ * @brief   Marks all blocks on the quick lists free and merges all neighbouring
+ *          free blocks in one pass over the block list.
+ */
+static void sweep_deferred(void) {
+    if (stats.deferred_blocks == 0) return;
+
+    for (int i = 0; i < QUICK_LISTS; i++) {
+        for (BlockHeader *block = quick[i]; block != NULL; ) {
+            BlockHeader *next = GET_LINK(block);
+            SET_FREE(block, 1);
+            free_insert(block);
+            block = next;
+        }
+        quick[i] = NULL;
+    }
+    stats.deferred_blocks = 0;
+    stats.deferred_bytes = 0;
+
+    BlockHeader *p = first;
+    do {
+        BlockHeader *next = GET_NEXT(p);
+
+        if (GET_FREE(p) && GET_FREE(next) && next != first) {
+            free_erase(p);
+            do {
+                free_erase(next);
+                SET_NEXT(p, GET_NEXT(next));
+                stats.coalesces++;
+                if (current == next) current = p;
+                if (compact_cursor == next) compact_cursor = p;
+                next = GET_NEXT(p);
+            } while (GET_FREE(next) && next != first);
+            free_insert(p);
+
+            if (SIZE(p) >= RELEASE_THRESHOLD) release_pages(p);
+        }
+        p = next;
+    } while (p != first);
+
+    stats.sweeps++;
+}
+
+/**
+ * @name    padding_for
+ * @brief   Gives the number of bytes to skip at the start of free block so that
+ *          its user block becomes aligned to align.
+ */
+static size_t padding_for(BlockHeader *block, size_t align) {
+    uintptr_t user = (uintptr_t)block->user_block;
+    return ((user + align - 1) & ~(uintptr_t)(align - 1)) - user;
+}
+
+/**
+ * @name    max_padding
+ * @brief   Gives a bound on the padding that allocate may put in front of a user
+ *          block aligned to align.
+ */
+static size_t max_padding(size_t align) {
+    return align > sizeof(BlockHeader) ? align + MIN_SIZE + sizeof(BlockHeader) : 0;
+}
+
+/**
+ * @name    too_large
+ * @brief   Tells whether a block of size bytes aligned to align could not be
+ *          described without its size, header and padding overflowing.
+ */
+static int too_large(size_t size, size_t align) {
+    return size > SIZE_MAX - 7 - sizeof(BlockHeader) - max_padding(align);
+}
+
+/**
+ * @name    allocate
+ * @brief   Next-fit search for a free block that can hold size bytes aligned to align.
+ *
+ * If the user block has to be moved up for alignment, the leading padding is split
+ * off as a free block of its own. Padding too small for a block is given to the
+ * block in front instead, or increased by align until it is large enough.
+ * If zero is set, the user block is cleared, skipping pages known to be zero.
+ */
+static void* allocate(size_t align, size_t size, int zero) {
     if (first == NULL) {
         simple_init();
         if (first == NULL) return NULL;
     }
 
+    if (too_large(size, align)) return NULL;
+
     size_t aligned_size = (size + 7) & ~0x7;  // Align to 8-byte boundary
+    if (aligned_size < MIN_SIZE) aligned_size = MIN_SIZE;
+
+    if (deferred && align == sizeof(BlockHeader) && aligned_size <= QUICK_MAX_SIZE) {
+        BlockHeader *block = undefer_block(aligned_size);
+        if (block != NULL) {
+            void *user_block = (void *)(block->user_block);
+            if (zero) memset(user_block, 0, size);
+            RECORD_MALLOC(user_block, size);
+            return user_block;
+        }
+    }
+
+    if (best_fit) {
+        // Start at the best fit, with the same bound the search below checks;
+        // any alignment padding has to fit too
+        size_t need = aligned_size + sizeof(BlockHeader) + max_padding(align);
+
+        BlockHeader *fit = tree_best_fit(need);
+        if (fit != NULL) current = fit;
+    }
 
     BlockHeader *search_start = current;  // Start from the current block
+    BlockHeader *prev = NULL;             // Block physically in front of current, if known
 
     do {
         if (GET_FREE(current)) {
-            if (SIZE(current) >= aligned_size + sizeof(BlockHeader)) {
-                size_t remaining_size = SIZE(current) - aligned_size - sizeof(BlockHeader);
-
-                if (remaining_size >= MIN_SIZE + sizeof(BlockHeader)) {
-                    // Split the block if there's enough space left for a new block
-                    BlockHeader *new_block = (BlockHeader *)((uintptr_t)current + sizeof(BlockHeader) + aligned_size);
-                    SET_NEXT(new_block, GET_NEXT(current));
-                    SET_FREE(new_block, 1);
-                    SET_NEXT(current, new_block);
+            size_t padding = padding_for(current, align);
+            int give_to_prev = 0;
+
+            if (padding > 0 && padding < MIN_SIZE + sizeof(BlockHeader)) {
+                // The block in front must not be on a quick list, as its size would change
+                if (prev != NULL && stats.deferred_blocks == 0) give_to_prev = 1;
+                else while (padding < MIN_SIZE + sizeof(BlockHeader)) padding += align;
+            }
+
+            if (SIZE(current) >= padding + aligned_size + sizeof(BlockHeader)) {
+                free_erase(current);
+
+                BlockHeader *block = current;
+                if (padding > 0) {
+                    block = (BlockHeader *)((uintptr_t)current + padding);
+                    mark_dirty(block, sizeof(BlockHeader));
+                    SET_NEXT(block, GET_NEXT(current));
+                    SET_FREE(block, 1);
+
+                    if (give_to_prev) {
+                        // Grow the block in front, keeping its statistics right
+                        if (compact_cursor == current) compact_cursor = prev;
+                        if (GET_FREE(prev)) free_erase(prev);
+                        else stats_used_remove(SIZE(prev));
+                        SET_NEXT(prev, block);
+                        if (GET_FREE(prev)) free_insert(prev);
+                        else stats_used_add(SIZE(prev));
+                    } else {
+                        // Leading padding stays behind as a free block
+                        SET_NEXT(current, block);
+                        free_insert(current);
+                        stats.splits++;
+                    }
                 }
 
-                // Mark current block as not free
-                SET_FREE(current, 0);
+                split_block(block, aligned_size);
+
+                // Mark block as not free
+                SET_FREE(block, 0);
+                stats_used_add(SIZE(block));
+                stats.allocs++;
 
                 // Return the pointer to the user block
-                void *user_block = (void *)(current->user_block);
+                void *user_block = (void *)(block->user_block);
+                if (zero) zero_dirty(user_block, size);
+                mark_dirty(user_block, SIZE(block));
 
                 // Move to the next block for future allocations
-                current = GET_NEXT(current);  // Continue from the next block for future allocations
+                current = GET_NEXT(block);  // Continue from the next block for future allocations
+
+                RECORD_MALLOC(user_block, size);
 
                 return user_block;
             }
         }
 
+        prev = current;
         current = GET_NEXT(current);  // Move to the next block
+        if (current == first) prev = NULL;  // The list wraps around from last to first
     } while (current != search_start);  // Wrap around if necessary
 
+    if (stats.deferred_blocks > 0) {
+        // Merge the quick lists back into the heap and try again
+        sweep_deferred();
+        return allocate(align, size, zero);
+    }
+
     return NULL;  // No suitable block found
 }
 
+void* block_alloc(size_t align, size_t size, int zero) {
+    return allocate(align, size, zero);
+}
 
-void simple_free(void *ptr) {
-    if (!ptr) return;
+void* simple_malloc(size_t size) {
+    if (small_enabled && size <= SMALL_MAX_SIZE) {
+        void *ptr = small_alloc(size);
+        if (ptr) {
+            RECORD_MALLOC(ptr, size);
+            return ptr;
+        }
+    }
+    return allocate(sizeof(BlockHeader), size, 0);
+}
 
-    BlockHeader *block = (BlockHeader *)((uintptr_t)ptr - sizeof(BlockHeader));  // Find the block for the given pointer
+void* simple_calloc(size_t n, size_t size) {
+    return simple_calloc_aligned(sizeof(BlockHeader), n, size);
+}
 
-    if (GET_FREE(block)) {
-        // Block is already free, return to avoid double free
-        return;
+void* simple_calloc_aligned(size_t align, size_t n, size_t size) {
+    if (size != 0 && n > SIZE_MAX / size) return NULL;
+    if (align & (align - 1)) return NULL;  // Not a power of two
+    if (align < sizeof(BlockHeader)) align = sizeof(BlockHeader);
+
+    if (small_enabled && align == sizeof(BlockHeader) && n * size <= SMALL_MAX_SIZE) {
+        void *ptr = small_alloc(n * size);
+        if (ptr) {
+            memset(ptr, 0, n * size);
+            RECORD_MALLOC(ptr, n * size);
+            return ptr;
+        }
     }
+    return allocate(align, n * size, 1);
+}
+
+void* simple_memalign(size_t align, size_t size) {
+    if (align & (align - 1)) return NULL;  // Not a power of two
+    if (align < sizeof(BlockHeader)) align = sizeof(BlockHeader);
+    return allocate(align, size, 0);
+}
+
+void* simple_aligned_alloc(size_t align, size_t size) {
+    if (align == 0 || (align & (align - 1)) || size % align != 0) return NULL;
+    return simple_memalign(align, size);
+}
+
+
+/**
+ * @name    free_block
+ * @brief   Marks an allocated block free and coalesces it with free neighbours.
+ *
+ * prev_block must be the block in front of block, or NULL to have it looked up
+ * by walking the list from first.
+ * @retval  The free block that now contains block.
+ */
+static BlockHeader *free_block(BlockHeader *block, BlockHeader *prev_block) {
+    RECORD_FREE(block->user_block);
 
     SET_FREE(block, 1);  // Mark the block as free
+    stats_used_remove(SIZE(block));
+    stats.frees++;
 
     // Coalesce with next block if it's free
     BlockHeader *next_block = GET_NEXT(block);
     if (GET_FREE(next_block)) {
         // Merge with the next block
+        free_erase(next_block);
         SET_NEXT(block, GET_NEXT(next_block));
+        stats.coalesces++;
+        if (current == next_block) current = block;  // Do not leave current inside the merged block
+        if (compact_cursor == next_block) compact_cursor = block;
     }
 
     // Coalesce with previous block if it's free
-    BlockHeader *prev_block = first;
-    while (GET_NEXT(prev_block) != block && prev_block != last) {
-        prev_block = GET_NEXT(prev_block);
+    if (prev_block == NULL) {
+        prev_block = first;
+        while (GET_NEXT(prev_block) != block && prev_block != last) {
+            prev_block = GET_NEXT(prev_block);
+        }
     }
 
     if (GET_FREE(prev_block)) {
+        free_erase(prev_block);
         SET_NEXT(prev_block, GET_NEXT(block));  // Merge the previous block with the current one
+        stats.coalesces++;
+        if (current == block) current = prev_block;
+        if (compact_cursor == block) compact_cursor = prev_block;
+        block = prev_block;
+    }
+
+    free_insert(block);
+
+    if (SIZE(block) >= RELEASE_THRESHOLD) release_pages(block);
+
+    return block;
+}
+
+void simple_free(void *ptr) {
+    if (!ptr) return;
+
+    if (small_owns(ptr)) {
+        RECORD_FREE(ptr);
+        small_free(ptr);
+        return;
+    }
+
+    BlockHeader *block = (BlockHeader *)((uintptr_t)ptr - sizeof(BlockHeader));  // Find the block for the given pointer
+
+    if (GET_FREE(block)) {
+        // Block is already free, return to avoid double free
+        return;
+    }
+
+    if (deferred && SIZE(block) <= QUICK_MAX_SIZE) {
+        RECORD_FREE(ptr);
+        defer_block(block);
+
+        if (stats.deferred_bytes >= QUICK_SWEEP_MIN &&
+            stats.deferred_bytes > stats.bytes_in_use / QUICK_SWEEP_SHARE) sweep_deferred();
+        return;
+    }
+
+    free_block(block, NULL);
+}
+
+
+size_t simple_malloc_batch(size_t size, size_t n, void **out) {
+    if (first == NULL) {
+        simple_init();
+        if (first == NULL) return 0;
     }
+
+    size_t count = 0;
+    if (small_enabled && size <= SMALL_MAX_SIZE) {
+        // From the size classes while they have room, like simple_malloc
+        for (; count < n; count++) {
+            out[count] = small_alloc(size);
+            if (out[count] == NULL) break;
+            RECORD_MALLOC(out[count], size);
+        }
+        if (count == n) return n;
+    }
+
+    size_t aligned_size = (size + 7) & ~0x7;  // Align to 8-byte boundary
+    if (aligned_size < MIN_SIZE) aligned_size = MIN_SIZE;
+    if (aligned_size < size) return count;    // Size overflowed
+
+    BlockHeader *search_start = current;
+
+    do {
+        // Carve consecutive blocks off the front of this free region
+        while (count < n && GET_FREE(current) && SIZE(current) >= aligned_size) {
+            BlockHeader *block = current;
+
+            free_erase(block);
+            split_block(block, aligned_size);
+            SET_FREE(block, 0);
+            stats_used_add(SIZE(block));
+            stats.allocs++;
+
+            out[count++] = block->user_block;
+            mark_dirty(block->user_block, SIZE(block));
+            RECORD_MALLOC(block->user_block, size);
+
+            current = GET_NEXT(block);
+        }
+        if (count == n) break;
+
+        current = GET_NEXT(current);
+    } while (current != search_start);
+
+    if (count < n && stats.deferred_blocks > 0) {
+        // Merge the quick lists back into the heap and carve the rest
+        sweep_deferred();
+        return count + simple_malloc_batch(size, n - count, out + count);
+    }
+
+    return count;
+}
+
+
+static int compare_addresses(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(void * const *)a, y = (uintptr_t)*(void * const *)b;
+    return (x > y) - (x < y);
+}
+
+void simple_free_batch(void **ptrs, size_t n) {
+    if (first == NULL || n == 0) return;
+
+    qsort(ptrs, n, sizeof(void *), compare_addresses);
+
+    // Small objects first, since freeing them may free their page and change the list
+    for (size_t i = 0; i < n; i++) {
+        if (ptrs[i] != NULL && small_owns(ptrs[i])) {
+            simple_free(ptrs[i]);
+            ptrs[i] = NULL;
+        }
+    }
+
+    // One sweep through the list, keeping track of the block in front
+    BlockHeader *prev_block = NULL;
+    BlockHeader *p = first;
+
+    for (size_t i = 0; i < n; i++) {
+        if (ptrs[i] == NULL) continue;
+
+        BlockHeader *block = (BlockHeader *)((uintptr_t)ptrs[i] - sizeof(BlockHeader));
+        while ((uintptr_t)p < (uintptr_t)block && p != last) {
+            prev_block = p;
+            p = GET_NEXT(p);
+        }
+        if (p != block) continue;           // Not a block of this heap
+        if (GET_FREE(block)) continue;      // Already free
+
+        p = free_block(block, prev_block != NULL ? prev_block : last);
+        prev_block = NULL;                  // Only needed again after moving past p
+    }
+}
+
+
+void* simple_realloc(void *ptr, size_t size) {
+    if (!ptr) return simple_malloc(size);
+    if (size == 0) {
+        simple_free(ptr);
+        return NULL;
+    }
+
+    if (small_owns(ptr)) {
+        size_t old_size = small_size(ptr);
+        if (size <= old_size) return ptr;
+
+        void *new_ptr = simple_malloc(size);
+        if (!new_ptr) return NULL;
+        memcpy(new_ptr, ptr, old_size);
+        simple_free(ptr);
+        return new_ptr;
+    }
+
+    if (too_large(size, sizeof(BlockHeader))) return NULL;  // Old block is left untouched
+
+    BlockHeader *block = (BlockHeader *)((uintptr_t)ptr - sizeof(BlockHeader));
+    size_t aligned_size = (size + 7) & ~0x7;
+    size_t old_size = SIZE(block);
+
+    if (aligned_size <= old_size) return ptr;  // Already large enough
+
+    // Grow in place by absorbing the next block if it is free and large enough
+    BlockHeader *next_block = GET_NEXT(block);
+    if (GET_FREE(next_block) && old_size + sizeof(BlockHeader) + SIZE(next_block) >= aligned_size) {
+        RECORD_FREE(ptr);
+
+        free_erase(next_block);
+        stats_used_remove(old_size);
+        SET_NEXT(block, GET_NEXT(next_block));
+        stats.coalesces++;
+        if (current == next_block) current = block;
+        if (compact_cursor == next_block) compact_cursor = block;
+
+        split_block(block, aligned_size);
+        stats_used_add(SIZE(block));
+        mark_dirty(ptr, SIZE(block));
+
+        RECORD_MALLOC(ptr, size);
+        return ptr;
+    }
+
+    void *new_ptr = simple_malloc(size);
+    if (!new_ptr) return NULL;  // Old block is left untouched
+
+    memcpy(new_ptr, ptr, old_size);
+    simple_free(ptr);
+    return new_ptr;
+}
+
+
+size_t simple_usable_size(void *ptr) {
+    if (!ptr) return 0;
+    if (small_owns(ptr)) return small_size(ptr);
+
+    BlockHeader *block = (BlockHeader *)((uintptr_t)ptr - sizeof(BlockHeader));
+    return SIZE(block);
+}
+
+
+void simple_small_objects(int enable) {
+    small_enabled = enable;
+}
+
+
+int simple_heap_open(const char *path, size_t size) {
+    if (first != NULL || small_enabled) return -1;
+    if (memory_setup_file(path, size) != 0) return -1;
+
+    simple_init();
+    return first != NULL ? 0 : -1;
+}
+
+
+int simple_heap_hugepages(size_t size) {
+    if (first != NULL) return -1;
+
+    int ret = memory_setup_huge(size);
+    if (ret < 0) return -1;
+
+    simple_init();
+    return first != NULL ? ret : -1;
+}
+
+
+int simple_heap_sync(void) {
+    sweep_deferred();
+    return memory_sync();
+}
+
+
+size_t simple_compact(size_t max_bytes, int (*movable)(void *ptr), void (*moved)(void *from, void *to)) {
+    if (first == NULL) return 0;
+
+    sweep_deferred();   // Blocks on quick lists would stand in the way
+
+    // Go on where the last call stopped, so that small steps do not rescan the
+    // compacted front, and go round to the front once before giving up
+    size_t bytes = 0;
+    BlockHeader *start = compact_cursor != NULL ? compact_cursor : first;
+    BlockHeader *p = start;
+    int wrapped = 0;
+
+    while (bytes < max_bytes) {
+        if (p == last) {
+            if (start == first || wrapped) break;
+            wrapped = 1;
+            p = first;
+        }
+        if (wrapped && (uintptr_t)p >= (uintptr_t)start) break;
+
+        BlockHeader *block = GET_NEXT(p);
+
+        if (!GET_FREE(p) || GET_FREE(block) || block == last || !movable(block->user_block)) {
+            p = block;
+            continue;
+        }
+
+        // Slide block down over the free block p, which then follows it
+        size_t size = SIZE(block);
+        BlockHeader *after = GET_NEXT(block);
+        BlockHeader *hole = (BlockHeader *)((uintptr_t)p + sizeof(BlockHeader) + size);
+
+        free_erase(p);
+        memmove(p->user_block, block->user_block, size);
+        mark_dirty(p->user_block, size);
+        SET_NEXT(p, hole);
+        SET_FREE(p, 0);
+
+        mark_dirty(hole, sizeof(BlockHeader));
+        SET_NEXT(hole, after);
+        SET_FREE(hole, 1);
+        if (GET_FREE(after)) {
+            free_erase(after);
+            SET_NEXT(hole, GET_NEXT(after));
+            stats.coalesces++;
+        }
+        free_insert(hole);
+
+        if (current == block || current == after) current = hole;
+        moved(block->user_block, p->user_block);
+        if (trace_enabled) {
+            trace_record(TRACE_FREE, block->user_block, 0);
+            trace_record(TRACE_MALLOC, p->user_block, size);
+        }
+        if (prof_filter[prof_bucket(block->user_block)]) prof_moved(block->user_block, p->user_block);
+
+        stats.compaction_moves++;
+        stats.compaction_bytes += size;
+        bytes += size;
+        p = hole;
+    }
+
+    compact_cursor = p != last ? p : NULL;
+    return bytes;
+}
+
+
+void simple_deferred_coalescing(int enable) {
+    if (!enable) sweep_deferred();
+    deferred = enable;
+}
+
+
+void simple_best_fit(int enable) {
+    best_fit = enable;   // The free tree is kept up to date either way
+}
+
+
+HeapStats simple_heap_stats(void) {
+    HeapStats s = stats;
+
+    s.largest_free = tree_largest();
+
+    small_counts(&s.small_pages, &s.small_objects);
+    s.fragmentation = s.bytes_free ? 1.0 - (double) s.largest_free / (double) s.bytes_free : 0.0;
+    return s;
 }
 
 #include "mm_aux.c"
@@ -18,8 +18,15 @@ typedef struct header BlockHeader;
 
 extern BlockHeader *first;
 extern BlockHeader *current;
-extern const uintptr_t memory_start;
-extern const uintptr_t memory_end;
+extern uintptr_t memory_start;
+extern uintptr_t memory_end;
+extern int memory_file_backed;     // Set when the region is a mapped heap file
+extern size_t memory_page_size;    // Size of the pages backing the region
+
+/* Region setup in memory_setup.c, used by simple_heap_open, simple_heap_hugepages and simple_heap_sync */
+int memory_setup_file(const char *path, size_t size);
+int memory_setup_huge(size_t size);
+int memory_sync(void);
 
 
 /**
@@ -30,6 +37,42 @@ extern const uintptr_t memory_end;
 void * simple_malloc(size_t size);
 
 
+/**
+ * @name    simple_calloc
+ * @brief   Allocate zero initialized memory for n elements of size bytes each.
+ *          Only parts of the block that may have been written before are cleared.
+ * @retval  Pointer to the start of the allocated memory or NULL if not possible.
+ */
+void * simple_calloc(size_t n, size_t size);
+
+
+/**
+ * @name    simple_calloc_aligned
+ * @brief   Like simple_calloc, but the memory starts at a multiple of align (see simple_memalign).
+ * @retval  Pointer to the start of the allocated memory or NULL if not possible.
+ */
+void * simple_calloc_aligned(size_t align, size_t n, size_t size);
+
+
+/**
+ * @name    simple_memalign
+ * @brief   Allocate at least size bytes starting at an address that is a multiple of align.
+ *          Alignments below 8 are rounded up to 8.
+ * @retval  Pointer to the start of the allocated memory or NULL if not possible or align
+ *          is not a power of two.
+ */
+void * simple_memalign(size_t align, size_t size);
+
+
+/**
+ * @name    simple_aligned_alloc
+ * @brief   Like simple_memalign, but following the rules of C11 aligned_alloc:
+ *          align must be a power of two and size a multiple of align.
+ * @retval  Pointer to the start of the allocated memory or NULL if not possible.
+ */
+void * simple_aligned_alloc(size_t align, size_t size);
+
+
 /**
  * @name    simple_free
  * @brief   Frees previously allocated memory and make it available for subsequent calls to simple_malloc.
@@ -37,6 +80,201 @@ void * simple_malloc(size_t size);
 void simple_free(void * ptr);
 
 
+/**
+ * @name    simple_malloc_batch
+ * @brief   Allocate n blocks of at least size bytes each, storing pointers to them in out.
+ *          Consecutive blocks are carved from the same free region in one pass, after
+ *          taking what the size-class pages have room for if small objects are enabled.
+ *          Deferred blocks are merged back when the free regions run short.
+ * @retval  Number of blocks allocated, less than n if the heap ran out of room.
+ */
+size_t simple_malloc_batch(size_t size, size_t n, void ** out);
+
+
+/**
+ * @name    simple_free_batch
+ * @brief   Frees n blocks in one sweep over the block list. The ptrs array is sorted
+ *          by address in place; NULL entries are ignored. Entries for small objects
+ *          are freed first and set to NULL, so the array is left changed.
+ */
+void simple_free_batch(void ** ptrs, size_t n);
+
+
+/**
+ * @name    simple_realloc
+ * @brief   Changes the size of the block at ptr to at least size bytes, keeping its contents.
+ *          Grows in place when the following block is free, otherwise moves the block.
+ * @retval  Pointer to the resized block, or NULL if not possible (ptr is then left valid).
+ */
+void * simple_realloc(void * ptr, size_t size);
+
+
+/**
+ * @name    simple_usable_size
+ * @brief   Gives the number of bytes available to the user in the block at ptr.
+ * @retval  Usable size of the block (at least the size requested), 0 if ptr is NULL.
+ */
+size_t simple_usable_size(void * ptr);
+
+
+/* Number of buckets in the free block size histogram */
+#define HEAP_STATS_BUCKETS  32
+
+/* Heap statistics as returned by simple_heap_stats() */
+typedef struct {
+  size_t   bytes_in_use;        // Payload bytes in allocated blocks
+  size_t   bytes_free;          // Payload bytes in free blocks
+  size_t   used_blocks;         // Number of allocated blocks
+  size_t   free_blocks;         // Number of free blocks
+  size_t   largest_free;        // Payload size of the largest free block
+  size_t   free_histogram[HEAP_STATS_BUCKETS];  // Bucket i counts free blocks of size [2^i, 2^(i+1))
+  double   fragmentation;       // External fragmentation: 1 - largest_free / bytes_free
+  uint64_t allocs;              // Successful simple_malloc calls
+  uint64_t frees;               // simple_free calls that released a block
+  uint64_t splits;              // Free blocks split by simple_malloc
+  uint64_t coalesces;           // Free blocks merged with a neighbour by simple_free
+  uint64_t released_bytes;      // Bytes of free pages given back to the kernel
+  size_t   small_pages;         // Size-class pages in use (carved from chunks, each one used block)
+  size_t   small_objects;       // Live objects in size-class pages
+  size_t   deferred_blocks;     // Freed blocks waiting on quick lists (counted neither used nor free)
+  size_t   deferred_bytes;      // Payload bytes in deferred blocks
+  uint64_t sweeps;              // Bulk coalescing sweeps of the quick lists
+  uint64_t compaction_moves;    // Blocks moved by simple_compact
+  uint64_t compaction_bytes;    // Bytes moved by simple_compact
+} HeapStats;
+
+
+/**
+ * @name    simple_heap_stats
+ * @brief   Gives a snapshot of the heap statistics.
+ *
+ * All counters are maintained incrementally, so this does not walk the block list.
+ * largest_free is read off the tree of free blocks in O(log n) expected time.
+ * @retval  Current heap statistics (all zero if the heap is not initialized)
+ */
+HeapStats simple_heap_stats(void);
+
+
+/**
+ * @name    simple_small_objects
+ * @brief   Enables (1) or disables (0) serving requests of up to SMALL_MAX_SIZE bytes
+ *          from headerless size-class pages (see mm_small.h). Disabled by default.
+ *          Objects already allocated may be freed in either mode.
+ */
+void simple_small_objects(int enable);
+
+
+/**
+ * @name    simple_compact
+ * @brief   Slides allocated blocks down over the free blocks in front of them, so that
+ *          free space collects into larger blocks. Only blocks for which movable returns
+ *          true are moved, and moved is called with the old and new user pointer of each.
+ *          Stops after moving max_bytes, so that it can be run in small steps; the next
+ *          call goes on from there, and goes round to the front of the heap at the end.
+ * @retval  Number of bytes moved; 0 once no more blocks can be moved.
+ */
+size_t simple_compact(size_t max_bytes, int (*movable)(void * ptr), void (*moved)(void * from, void * to));
+
+
+/**
+ * @name    simple_deferred_coalescing
+ * @brief   Enables (1) or disables (0) deferred coalescing. When enabled, freed blocks of up
+ *          to 1024 bytes are kept on quick lists per exact size and reused by allocations
+ *          of that size without splitting. They are merged with their neighbours in one
+ *          sweep when an allocation would otherwise fail, or when the quick lists hold
+ *          more than 1/16 of the bytes in use. Disabling sweeps the quick lists.
+ */
+void simple_deferred_coalescing(int enable);
+
+
+/**
+ * @name    simple_best_fit
+ * @brief   Enables (1) or disables (0) best-fit placement. When enabled, free blocks are
+ *          indexed in a tree ordered by size and address, and each allocation takes the
+ *          smallest free block that fits. Disabled by default, which gives next-fit.
+ */
+void simple_best_fit(int enable);
+
+
+/**
+ * @name    simple_heap_open
+ * @brief   Places the heap in the file at path instead of the static region, so that it
+ *          survives the process. A new file of size bytes is created if none exists;
+ *          an existing one is mapped back at the address it was created at, with all
+ *          blocks still allocated. Must be called before the first allocation, and
+ *          with size-class pages disabled, as those are not kept in the file.
+ * @retval  0 if ok, -1 if the heap is already in use or the file could not be mapped.
+ */
+int simple_heap_open(const char * path, size_t size);
+
+
+/**
+ * @name    simple_heap_hugepages
+ * @brief   Places the heap in a new region of size bytes, rounded up to and aligned at
+ *          2 MB, backed by hugepages where possible to cut TLB misses when walking the
+ *          block list. Uses reserved hugetlb pages (MAP_HUGETLB) if available, otherwise
+ *          transparent hugepages (MADV_HUGEPAGE), otherwise normal pages. Free pages
+ *          are then only given back to the kernel in whole 2 MB pages. Must be called
+ *          before the first allocation.
+ * @retval  2 for hugetlb pages, 1 for transparent hugepages, 0 for normal pages,
+ *          -1 if the heap is already in use or the region could not be mapped.
+ */
+int simple_heap_hugepages(size_t size);
+
+
+/**
+ * @name    simple_heap_sync
+ * @brief   Merges deferred free blocks back into the heap and writes the heap file to disk.
+ *          Blocks still on quick lists at exit stay allocated in the file.
+ * @retval  0 if ok or the heap is not file backed, -1 on error.
+ */
+int simple_heap_sync(void);
+
+
+/**
+ * @name    simple_heap_root
+ * @brief   Gives the root object of a heap file, from which a restarted process finds
+ *          its data again.
+ * @retval  Pointer set by simple_heap_set_root, or NULL if none or not file backed.
+ */
+void * simple_heap_root(void);
+
+
+/**
+ * @name    simple_heap_set_root
+ * @brief   Stores ptr as the root object of the heap file. Does nothing if the heap
+ *          is not file backed.
+ */
+void simple_heap_set_root(void * ptr);
+
+
+/**
+ * @name    simple_trace_flush
+ * @brief   Writes buffered trace records to the trace file (see mm_trace.h).
+ *          Called automatically at exit; does nothing if tracing is disabled.
+ */
+void simple_trace_flush(void);
+
+
+/**
+ * @name    simple_profile
+ * @brief   Starts sampling allocations about once every sample_rate bytes (512 KB if 0)
+ *          for the heap profile written to path (see mm_prof.h), also at exit and on
+ *          SIGUSR2. A NULL path stops sampling and the dump at exit; the totals
+ *          collected so far are kept, and sampled blocks still leave them when freed.
+ */
+void simple_profile(const char * path, size_t sample_rate);
+
+
+/**
+ * @name    simple_profile_dump
+ * @brief   Writes the heap profile to path, or to the file given to simple_profile or
+ *          SIMPLE_PROFILE if path is NULL.
+ * @retval  0 if ok, -1 if the file could not be written.
+ */
+int simple_profile_dump(const char * path);
+
+
 /**
  * @name    simple_macro_test
  * @brief   Makes an internal test of the given macros
@@ -0,0 +1,94 @@
+/**
+ * @file   mm_backend.c
+ * @brief  Allocator backends for mm_replay and mm_bench.
+ *
+ * "simple" is the next-fit heap, "small" the same heap with size-class pages
+ * for small objects enabled, "bestfit" the same heap with best-fit placement,
+ * "deferred" the same heap with deferred coalescing, "huge" the same heap in a
+ * region backed by 2 MB pages, "buddy" the buddy allocator and "glibc" the
+ * system malloc. Only one backend may be used per process.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm.h"
+#include "mm_backend.h"
+#include "mm_buddy.h"
+
+
+static size_t simple_footprint(void) {
+  HeapStats s = simple_heap_stats();
+  return s.bytes_in_use + s.used_blocks * sizeof(void *);   // One header per block
+}
+
+static double simple_fragmentation(void) {
+  return simple_heap_stats().fragmentation;
+}
+
+
+/* glibc does not expose its largest free chunk, so fragmentation is the share of
+ * the heap that is free but not returned to the system */
+static size_t glibc_footprint(void) {
+  struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+}
+
+static double glibc_fragmentation(void) {
+  struct mallinfo2 mi = mallinfo2();
+  return mi.arena ? (double) mi.fordblks / (double) mi.arena : 0.0;
+}
+
+
+static size_t buddy_footprint(void) {
+  return buddy_heap_stats().bytes_in_use;   // Headers are inside the blocks
+}
+
+static double buddy_fragmentation(void) {
+  return buddy_heap_stats().fragmentation;
+}
+
+
+static void small_init(void) {
+  simple_small_objects(1);
+}
+
+static void bestfit_init(void) {
+  simple_best_fit(1);
+}
+
+static void deferred_init(void) {
+  simple_deferred_coalescing(1);
+}
+
+/* Same size as the static region, so that only the page size differs */
+static void huge_init(void) {
+  simple_heap_hugepages(32 * 1024 * 1024);
+}
+
+
+static const AllocBackend backends[] = {
+  { "simple",   NULL,          simple_malloc, simple_free, simple_realloc, simple_footprint, simple_fragmentation },
+  { "small",    small_init,    simple_malloc, simple_free, simple_realloc, simple_footprint, simple_fragmentation },
+  { "bestfit",  bestfit_init,  simple_malloc, simple_free, simple_realloc, simple_footprint, simple_fragmentation },
+  { "deferred", deferred_init, simple_malloc, simple_free, simple_realloc, simple_footprint, simple_fragmentation },
+  { "huge",     huge_init,     simple_malloc, simple_free, simple_realloc, simple_footprint, simple_fragmentation },
+  { "buddy",    NULL,          buddy_malloc,  buddy_free,  buddy_realloc,  buddy_footprint,  buddy_fragmentation  },
+  { "glibc",    NULL,          malloc,        free,        realloc,        glibc_footprint,  glibc_fragmentation  },
+};
+
+#define NUM_BACKENDS  (sizeof(backends) / sizeof(backends[0]))
+
+const AllocBackend * alloc_backend(const char *name) {
+  for (size_t i = 0; i < NUM_BACKENDS; i++) {
+    if (strcmp(backends[i].name, name) == 0) return &backends[i];
+  }
+  return NULL;
+}
+
+const AllocBackend * alloc_backend_at(size_t i) {
+  return i < NUM_BACKENDS ? &backends[i] : NULL;
+}
@@ -0,0 +1,35 @@
+/**
+ * @file   mm_backend.h
+ * @brief  Common interface to the allocators that mm_replay and mm_bench can drive.
+ */
+
+#ifndef MM_BACKEND_H
+#define MM_BACKEND_H
+
+#include <stddef.h>
+
+typedef struct {
+  const char *name;
+  void   (*init)(void);           // Called once before the first allocation, may be NULL
+  void * (*malloc)(size_t size);
+  void   (*free)(void *ptr);
+  void * (*realloc)(void *ptr, size_t size);
+  size_t (*footprint)(void);      // Bytes currently held by live allocations, including block overhead
+  double (*fragmentation)(void);  // Backend specific fragmentation measure in [0, 1]
+} AllocBackend;
+
+/**
+ * @name    alloc_backend
+ * @brief   Looks up an allocator backend by name.
+ * @retval  Pointer to the backend or NULL if there is no backend with that name.
+ */
+const AllocBackend * alloc_backend(const char *name);
+
+/**
+ * @name    alloc_backend_at
+ * @brief   Iterates over the available backends.
+ * @retval  Pointer to backend number i or NULL if there are no more backends.
+ */
+const AllocBackend * alloc_backend_at(size_t i);
+
+#endif /* MM_BACKEND_H */
@@ -0,0 +1,302 @@
+/**
+ * @file   mm_bench.c
+ * @brief  Allocator benchmark comparing the backends of mm_backend.h.
+ *
+ * Usage: mm_bench [-n ops] [-w workload] [-a backend]
+ *
+ * Every workload is run against every backend in a child process of its own,
+ * so each run starts from a fresh heap and gets its own peak RSS. Results are
+ * printed as a tab separated table with one header line.
+ *
+ * Latencies are measured per malloc/free/realloc call and include the cost of
+ * reading the clock (a few tens of nanoseconds).
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "mm_backend.h"
+
+
+/* State of one run */
+typedef struct {
+  const AllocBackend *backend;
+  size_t    ops;          // Number of operations to perform
+  size_t    done;         // Number of operations performed
+  uint64_t *latency;      // Latency of each operation in ns
+  uint64_t  rng;
+  size_t    failed;       // Allocations that returned NULL
+  uint64_t  elapsed_ns;   // Time spent on the operations, if not the whole run
+} Run;
+
+typedef struct {
+  const char *name;
+  void (*run)(Run *r);
+} Workload;
+
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/* xorshift64, so that every backend sees the same sequence of requests */
+static uint64_t rnd(Run *r) {
+  r->rng ^= r->rng << 13;
+  r->rng ^= r->rng >> 7;
+  r->rng ^= r->rng << 17;
+  return r->rng;
+}
+
+static size_t rnd_size(Run *r, size_t lo, size_t hi) {
+  return lo + rnd(r) % (hi - lo + 1);
+}
+
+static void * timed_malloc(Run *r, size_t size) {
+  uint64_t t = now_ns();
+  void *p = r->backend->malloc(size);
+  r->latency[r->done++] = now_ns() - t;
+  if (p == NULL) r->failed++;
+  else memset(p, 0xA5, size < 64 ? size : 64);   // Touch the block like a real user would
+  return p;
+}
+
+static void timed_free(Run *r, void *p) {
+  uint64_t t = now_ns();
+  r->backend->free(p);
+  r->latency[r->done++] = now_ns() - t;
+}
+
+static void * timed_realloc(Run *r, void *p, size_t size) {
+  uint64_t t = now_ns();
+  void *q = r->backend->realloc(p, size);
+  r->latency[r->done++] = now_ns() - t;
+  if (q == NULL) r->failed++;
+  return q;
+}
+
+static int done(Run *r, size_t pending) {
+  return r->done + pending >= r->ops;
+}
+
+
+/* Fixed size churn: a window of 64 byte blocks where the oldest is replaced */
+static void churn(Run *r) {
+  void *slot[256] = { NULL };
+  for (size_t i = 0; !done(r, 2 + 256); i = (i + 1) % 256) {
+    if (slot[i]) timed_free(r, slot[i]);
+    slot[i] = timed_malloc(r, 64);
+  }
+  for (int i = 0; i < 256; i++) if (slot[i]) timed_free(r, slot[i]);
+}
+
+/* Random sizes: random slots are freed if in use, otherwise allocated */
+static void random_sizes(Run *r) {
+  void *slot[1024] = { NULL };
+  while (!done(r, 1 + 1024)) {
+    size_t i = rnd(r) % 1024;
+    if (slot[i]) {
+      timed_free(r, slot[i]);
+      slot[i] = NULL;
+    } else {
+      slot[i] = timed_malloc(r, rnd_size(r, 8, 4096));
+    }
+  }
+  for (int i = 0; i < 1024; i++) if (slot[i]) timed_free(r, slot[i]);
+}
+
+/* Producer/consumer: bursts of messages are produced and consumed in FIFO order */
+static void producer_consumer(Run *r) {
+  enum { CAP = 512 };
+  void *ring[CAP];
+  size_t head = 0, tail = 0;    // Consume at head, produce at tail
+
+  while (!done(r, 2 * 64 + CAP)) {   // A burst of each, then draining the ring
+    size_t burst = rnd_size(r, 1, 64);
+    for (size_t i = 0; i < burst && tail - head < CAP; i++) {
+      ring[tail++ % CAP] = timed_malloc(r, rnd_size(r, 16, 512));
+    }
+    burst = rnd_size(r, 1, 64);
+    for (size_t i = 0; i < burst && head < tail; i++) {
+      void *p = ring[head++ % CAP];
+      if (p) timed_free(r, p);
+    }
+  }
+  while (head < tail) {
+    void *p = ring[head++ % CAP];
+    if (p) timed_free(r, p);
+  }
+}
+
+/* LIFO and FIFO lifetimes: allocate a batch of blocks, then free them in reverse or same order */
+static void lifetimes(Run *r, int lifo) {
+  enum { DEPTH = 512 };
+  void *blocks[DEPTH];
+
+  while (!done(r, 2 * DEPTH)) {
+    for (int i = 0; i < DEPTH; i++) blocks[i] = timed_malloc(r, rnd_size(r, 16, 256));
+    for (int i = 0; i < DEPTH; i++) {
+      void *p = blocks[lifo ? DEPTH - 1 - i : i];
+      if (p) timed_free(r, p);
+    }
+  }
+}
+
+static void lifo(Run *r) { lifetimes(r, 1); }
+static void fifo(Run *r) { lifetimes(r, 0); }
+
+/* Realloc growth: buffers grow in small steps up to 64 KB and are then restarted */
+static void realloc_growth(Run *r) {
+  enum { BUFFERS = 16 };
+  void  *buf[BUFFERS] = { NULL };
+  size_t size[BUFFERS] = { 0 };
+
+  while (!done(r, 1 + BUFFERS)) {
+    size_t i = rnd(r) % BUFFERS;
+    if (size[i] >= 64 * 1024) {
+      timed_free(r, buf[i]);
+      buf[i] = NULL;
+      size[i] = 0;
+      continue;
+    }
+    size_t new_size = size[i] + rnd_size(r, 1, 256);
+    void *p = timed_realloc(r, buf[i], new_size);
+    if (p) {
+      buf[i] = p;
+      size[i] = new_size;
+    }
+  }
+  for (int i = 0; i < BUFFERS; i++) if (buf[i]) timed_free(r, buf[i]);
+}
+
+/*
+ * Long block list: the heap holds WALK_BLOCKS blocks of about a page each, and
+ * random blocks are freed and allocated again. The simple heap walks the block
+ * list on every free to find the block in front, and on allocations to get
+ * back to the hole, touching one header per page, so this measures the cost of
+ * the walk including TLB misses. Since each operation walks thousands of
+ * blocks, at most WALK_OPS operations are run. Setting up and tearing down the
+ * list is not timed, so that only the operations on the long list are counted.
+ */
+static void walk(Run *r) {
+  enum { WALK_BLOCKS = 2048, WALK_OPS = 100000, WALK_SIZE = 4000 };
+  void *blocks[WALK_BLOCKS];
+
+  if (r->ops > WALK_OPS) r->ops = WALK_OPS;
+
+  for (int i = 0; i < WALK_BLOCKS; i++) {
+    blocks[i] = r->backend->malloc(WALK_SIZE);
+    if (blocks[i] == NULL) r->failed++;
+  }
+  uint64_t start = now_ns();
+  while (!done(r, 2)) {
+    size_t i = rnd(r) % WALK_BLOCKS;
+    if (blocks[i]) timed_free(r, blocks[i]);
+    blocks[i] = timed_malloc(r, WALK_SIZE);
+  }
+  r->elapsed_ns = now_ns() - start;
+  for (int i = 0; i < WALK_BLOCKS; i++) if (blocks[i]) r->backend->free(blocks[i]);
+}
+
+
+static const Workload workloads[] = {
+  { "churn",    churn },
+  { "random",   random_sizes },
+  { "prodcons", producer_consumer },
+  { "lifo",     lifo },
+  { "fifo",     fifo },
+  { "realloc",  realloc_growth },
+  { "walk",     walk },
+};
+
+#define NUM_WORKLOADS  (sizeof(workloads) / sizeof(workloads[0]))
+
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+static uint64_t percentile(uint64_t *sorted, size_t n, double p) {
+  return n ? sorted[(size_t) (p * (n - 1))] : 0;
+}
+
+/* Runs one workload against one backend and prints its result row; called in a child process */
+static void run_one(const Workload *w, const AllocBackend *backend, size_t ops) {
+  Run r = { backend, ops, 0, NULL, 0x9E3779B97F4A7C15ull, 0, 0 };
+
+  // Keep the latency samples out of the heap being measured
+  r.latency = mmap(NULL, ops * sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (r.latency == MAP_FAILED) exit(1);
+
+  if (backend->init) backend->init();
+
+  uint64_t start = now_ns();
+  w->run(&r);
+  double secs = (r.elapsed_ns ? r.elapsed_ns : now_ns() - start) * 1e-9;
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+
+  qsort(r.latency, r.done, sizeof(uint64_t), cmp_u64);
+  printf("%s\t%s\t%zu\t%zu\t%.6f\t%.0f\t%lu\t%lu\t%lu\t%lu\t%ld\n",
+         w->name, backend->name, r.done, r.failed, secs, r.done / secs,
+         percentile(r.latency, r.done, 0.50), percentile(r.latency, r.done, 0.99),
+         percentile(r.latency, r.done, 0.999), r.done ? r.latency[r.done - 1] : 0,
+         ru.ru_maxrss);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  size_t ops = 1000000;
+  const char *only_workload = NULL;
+  const char *only_backend = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:w:a:")) != -1) {
+    switch (opt) {
+      case 'n': ops = strtoul(optarg, NULL, 10); break;
+      case 'w': only_workload = optarg; break;
+      case 'a': only_backend = optarg; break;
+      default:
+        fprintf(stderr, "Usage: %s [-n ops] [-w workload] [-a backend]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  int incomplete = 0;
+  printf("workload\tbackend\tops\tfailed\tseconds\tops_per_sec\tp50_ns\tp99_ns\tp999_ns\tmax_ns\tpeak_rss_kb\n");
+  fflush(stdout);
+
+  for (size_t i = 0; i < NUM_WORKLOADS; i++) {
+    if (only_workload && strcmp(only_workload, workloads[i].name) != 0) continue;
+
+    const AllocBackend *backend;
+    for (size_t j = 0; (backend = alloc_backend_at(j)) != NULL; j++) {
+      if (only_backend && strcmp(only_backend, backend->name) != 0) continue;
+
+      pid_t pid = fork();
+      if (pid == 0) {
+        run_one(&workloads[i], backend, ops);
+        _exit(0);
+      }
+      int status;
+      waitpid(pid, &status, 0);
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s/%s did not complete\n", workloads[i].name, backend->name);
+        incomplete = 1;
+      }
+    }
+  }
+  return incomplete;
+}
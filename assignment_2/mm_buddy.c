@@ -0,0 +1,163 @@
+/**
+ * @file   mm_buddy.c
+ * @brief  Binary buddy allocator (see mm_buddy.h).
+ *
+ * Every block starts with an 8 byte header holding its order. Free blocks also
+ * hold the links of their free list. Whether a block is free is kept out of
+ * line in a byte map with one entry per smallest block (order + 1 if a free
+ * block starts there, otherwise 0), so that user data can never be mistaken
+ * for a free buddy. The map lives at the start of the region.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mm_buddy.h"
+
+#define MIN_BLOCK   ((uintptr_t)1 << BUDDY_MIN_ORDER)
+
+typedef struct buddy_block {
+  uint64_t order;                 // Order of the block (size is 1 << order)
+  struct buddy_block *next;       // Free list links, only valid in free blocks
+  struct buddy_block *prev;
+} BuddyBlock;
+
+static uintptr_t base = 0;        // Offsets used for buddy lookup are relative to base
+static uintptr_t end = 0;
+static uint8_t *free_map = NULL;
+static BuddyBlock *free_lists[BUDDY_MAX_ORDER + 1];
+static uint64_t nonempty = 0;     // Bit k set when free_lists[k] is not empty
+static HeapStats stats;
+
+static uint8_t * map_entry(BuddyBlock *b) {
+  return &free_map[((uintptr_t)b - base) >> BUDDY_MIN_ORDER];
+}
+
+static void push_free(BuddyBlock *b, int k) {
+  b->order = k;
+  b->prev = NULL;
+  b->next = free_lists[k];
+  if (b->next) b->next->prev = b;
+  free_lists[k] = b;
+  nonempty |= (uint64_t)1 << k;
+  *map_entry(b) = k + 1;
+
+  stats.free_blocks++;
+  stats.bytes_free += (size_t)1 << k;
+  stats.free_histogram[k < HEAP_STATS_BUCKETS ? k : HEAP_STATS_BUCKETS - 1]++;
+}
+
+static void remove_free(BuddyBlock *b, int k) {
+  if (b->prev) b->prev->next = b->next;
+  else free_lists[k] = b->next;
+  if (b->next) b->next->prev = b->prev;
+  if (free_lists[k] == NULL) nonempty &= ~((uint64_t)1 << k);
+  *map_entry(b) = 0;
+
+  stats.free_blocks--;
+  stats.bytes_free -= (size_t)1 << k;
+  stats.free_histogram[k < HEAP_STATS_BUCKETS ? k : HEAP_STATS_BUCKETS - 1]--;
+}
+
+static void buddy_init(void) {
+  uintptr_t start = (memory_start + MIN_BLOCK - 1) & ~(MIN_BLOCK - 1);
+  end = memory_end & ~(MIN_BLOCK - 1);
+
+  // Reserve the free map at the start, then cut the rest into aligned power-of-two blocks
+  size_t map_size = (end - start) >> BUDDY_MIN_ORDER;
+  free_map = (uint8_t *)start;
+  base = (start + map_size + MIN_BLOCK - 1) & ~(MIN_BLOCK - 1);
+  memset(free_map, 0, map_size);
+
+  uintptr_t p = base;
+  for (int k = BUDDY_MAX_ORDER; k >= BUDDY_MIN_ORDER; k--) {
+    while (end - p >= ((uintptr_t)1 << k)) {
+      push_free((BuddyBlock *)p, k);
+      p += (uintptr_t)1 << k;
+    }
+  }
+}
+
+static int order_for(size_t size) {
+  size_t need = size + sizeof(uint64_t);
+  if (need < size) return -1;
+  int k = BUDDY_MIN_ORDER;
+  while (k <= BUDDY_MAX_ORDER && ((size_t)1 << k) < need) k++;
+  return k <= BUDDY_MAX_ORDER ? k : -1;
+}
+
+void * buddy_malloc(size_t size) {
+  if (free_map == NULL) buddy_init();
+
+  int order = order_for(size);
+  if (order < 0) return NULL;
+
+  uint64_t candidates = nonempty & (~(uint64_t)0 << order);
+  if (candidates == 0) return NULL;
+
+  int k = __builtin_ctzll(candidates);
+  BuddyBlock *b = free_lists[k];
+  remove_free(b, k);
+
+  // Split down to the requested order, freeing the upper halves
+  while (k > order) {
+    k--;
+    push_free((BuddyBlock *)((uintptr_t)b + ((uintptr_t)1 << k)), k);
+    stats.splits++;
+  }
+
+  b->order = k;
+  stats.used_blocks++;
+  stats.bytes_in_use += (size_t)1 << k;
+  stats.allocs++;
+  return (uint8_t *)b + sizeof(uint64_t);
+}
+
+void buddy_free(void *ptr) {
+  if (ptr == NULL) return;
+
+  BuddyBlock *b = (BuddyBlock *)((uint8_t *)ptr - sizeof(uint64_t));
+  if (*map_entry(b) != 0) return;   // Already free
+
+  int k = b->order;
+  stats.used_blocks--;
+  stats.bytes_in_use -= (size_t)1 << k;
+  stats.frees++;
+
+  while (k < BUDDY_MAX_ORDER) {
+    uintptr_t buddy = base + (((uintptr_t)b - base) ^ ((uintptr_t)1 << k));
+    if (buddy + ((uintptr_t)1 << k) > end || free_map[(buddy - base) >> BUDDY_MIN_ORDER] != k + 1) break;
+
+    remove_free((BuddyBlock *)buddy, k);
+    if (buddy < (uintptr_t)b) b = (BuddyBlock *)buddy;
+    k++;
+    stats.coalesces++;
+  }
+
+  push_free(b, k);
+}
+
+void * buddy_realloc(void *ptr, size_t size) {
+  if (ptr == NULL) return buddy_malloc(size);
+  if (size == 0) {
+    buddy_free(ptr);
+    return NULL;
+  }
+
+  BuddyBlock *b = (BuddyBlock *)((uint8_t *)ptr - sizeof(uint64_t));
+  size_t old_size = ((size_t)1 << b->order) - sizeof(uint64_t);
+  if (size <= old_size) return ptr;
+
+  void *new_ptr = buddy_malloc(size);
+  if (new_ptr == NULL) return NULL;
+  memcpy(new_ptr, ptr, old_size);
+  buddy_free(ptr);
+  return new_ptr;
+}
+
+HeapStats buddy_heap_stats(void) {
+  HeapStats s = stats;
+  s.largest_free = nonempty ? (size_t)1 << (63 - __builtin_clzll(nonempty)) : 0;
+  s.fragmentation = s.bytes_free ? 1.0 - (double)s.largest_free / (double)s.bytes_free : 0.0;
+  return s;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file   mm_buddy.h
+ * @brief  Binary buddy allocator over the memory_setup.c region.
+ *
+ * An alternative to the next-fit heap of mm.c for workloads of mostly
+ * power-of-two sizes. Blocks are powers of two from BUDDY_MIN_ORDER up, kept
+ * in one free list per order; splitting and merging find a block's buddy by
+ * XOR-ing its offset with its size, so both take O(log n) steps.
+ *
+ * Both allocators own the whole memory region, so a process must use either
+ * buddy_* or simple_*, never both.
+ */
+
+#ifndef MM_BUDDY_H
+#define MM_BUDDY_H
+
+#include <stddef.h>
+
+#include "mm.h"
+
+#define BUDDY_MIN_ORDER   5     // Smallest block is 32 bytes including its header
+#define BUDDY_MAX_ORDER   40
+
+/**
+ * @name    buddy_malloc
+ * @brief   Allocate at least size bytes from the buddy heap.
+ * @retval  Pointer to the start of the allocated memory or NULL if not possible.
+ */
+void * buddy_malloc(size_t size);
+
+/**
+ * @name    buddy_free
+ * @brief   Frees memory from buddy_malloc, merging it with free buddies.
+ */
+void buddy_free(void * ptr);
+
+/**
+ * @name    buddy_realloc
+ * @brief   Changes the size of a buddy block, keeping it in place while it still fits.
+ * @retval  Pointer to the resized block, or NULL if not possible (ptr is then left valid).
+ */
+void * buddy_realloc(void * ptr, size_t size);
+
+/**
+ * @name    buddy_heap_stats
+ * @brief   Gives the statistics of the buddy heap in the form used by simple_heap_stats.
+ *          The free histogram counts free blocks by order.
+ */
+HeapStats buddy_heap_stats(void);
+
+#endif /* MM_BUDDY_H */
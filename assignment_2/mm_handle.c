@@ -0,0 +1,126 @@
+/**
+ * @file   mm_handle.c
+ * @brief  Handle-based allocation with compaction (see mm_handle.h).
+ *
+ * The handle table maps a handle to the current address of its block and a
+ * lock count. Each block starts with its own handle number, so that the
+ * compaction in simple_compact can find the table entry of a block it moves.
+ * A block is only taken for a handle block if the table entry of that number
+ * points back at it.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+#include "mm_handle.h"
+
+typedef struct {
+  uint64_t handle;          // Handle number of the block
+  uint64_t data[0];         // User data
+} HandleBlock;
+
+typedef struct {
+  HandleBlock *block;       // NULL for unused entries
+  uint32_t locks;
+  uint32_t next_unused;     // Next entry on the unused list
+} HandleEntry;
+
+static HandleEntry *table = NULL;   // Entry 0 is never used
+static uint32_t table_size = 0;
+static uint32_t unused = 0;         // First unused entry, 0 if none
+
+static HandleEntry * entry(Handle h) {
+  if (h == 0 || h >= table_size || table[h].block == NULL) return NULL;
+  return &table[h];
+}
+
+static int grow_table(void) {
+  uint32_t new_size = table_size ? table_size * 2 : 64;
+  HandleEntry *new_table = simple_realloc(table, new_size * sizeof(HandleEntry));
+  if (new_table == NULL) return 0;
+
+  memset(&new_table[table_size], 0, (new_size - table_size) * sizeof(HandleEntry));
+  for (uint32_t h = new_size - 1; h >= table_size && h > 0; h--) {
+    new_table[h].next_unused = unused;
+    unused = h;
+  }
+  table = new_table;
+  table_size = new_size;
+  return 1;
+}
+
+
+static int handle_movable(void *ptr) {
+  HandleBlock *block = ptr;
+  uint64_t h = block->handle;
+  return h > 0 && h < table_size && table[h].block == block && table[h].locks == 0;
+}
+
+static void handle_moved(void *from, void *to) {
+  HandleBlock *block = to;
+  table[block->handle].block = block;
+}
+
+
+Handle hmalloc(size_t size) {
+  if (unused == 0 && !grow_table()) return 0;
+  if (size > SIZE_MAX - sizeof(HandleBlock)) return 0;
+
+  // simple_memalign never uses size-class pages, which could not be moved
+  HandleBlock *block = simple_memalign(sizeof(uint64_t), sizeof(HandleBlock) + size);
+  if (block == NULL) {
+    hcompact(SIZE_MAX);
+    block = simple_memalign(sizeof(uint64_t), sizeof(HandleBlock) + size);
+    if (block == NULL) return 0;
+  }
+
+  Handle h = unused;
+  unused = table[h].next_unused;
+  table[h].block = block;
+  table[h].locks = 0;
+  block->handle = h;
+  return h;
+}
+
+
+void hfree(Handle h) {
+  HandleEntry *e = entry(h);
+  if (e == NULL) return;
+
+  simple_free(e->block);
+  e->block = NULL;
+  e->next_unused = unused;
+  unused = h;
+}
+
+
+void * hlock(Handle h) {
+  HandleEntry *e = entry(h);
+  if (e == NULL) return NULL;
+
+  e->locks++;
+  return e->block->data;
+}
+
+
+void hunlock(Handle h) {
+  HandleEntry *e = entry(h);
+  if (e != NULL && e->locks > 0) e->locks--;
+}
+
+
+CompactStats hcompact(size_t max_bytes) {
+  CompactStats c;
+  HeapStats before = simple_heap_stats();
+
+  c.moved_bytes = simple_compact(max_bytes, handle_movable, handle_moved);
+
+  HeapStats after = simple_heap_stats();
+  c.moved_blocks = after.compaction_moves - before.compaction_moves;
+  c.largest_free_before = before.largest_free;
+  c.largest_free_after = after.largest_free;
+  c.free_blocks_before = before.free_blocks;
+  c.free_blocks_after = after.free_blocks;
+  return c;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file   mm_handle.h
+ * @brief  Handle-based allocation on top of the simple heap, with compaction.
+ *
+ * Blocks allocated with hmalloc are referred to by a handle instead of a
+ * pointer. Their address is only fixed while they are locked with hlock, so
+ * hcompact may slide unlocked blocks together and merge the free space between
+ * them. This avoids the external fragmentation that makes simple_malloc fail
+ * in long running processes although plenty of memory is free.
+ */
+
+#ifndef MM_HANDLE_H
+#define MM_HANDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t Handle;    // 0 is never a valid handle
+
+/* Result of a compaction pass */
+typedef struct {
+  size_t moved_blocks;        // Blocks moved
+  size_t moved_bytes;         // Bytes copied
+  size_t largest_free_before; // Largest free block before the pass
+  size_t largest_free_after;  // Largest free block after the pass
+  size_t free_blocks_before;  // Number of free blocks before the pass
+  size_t free_blocks_after;   // Number of free blocks after the pass
+} CompactStats;
+
+/**
+ * @name    hmalloc
+ * @brief   Allocate at least size bytes, compacting the heap first if no free block
+ *          is large enough.
+ * @retval  Handle of the new block, or 0 if not possible.
+ */
+Handle hmalloc(size_t size);
+
+/**
+ * @name    hfree
+ * @brief   Frees the block of handle h, locked or not.
+ */
+void hfree(Handle h);
+
+/**
+ * @name    hlock
+ * @brief   Pins the block of handle h in place. Locks nest; the block may be moved
+ *          again once hunlock has been called as many times as hlock.
+ * @retval  Current address of the block, or NULL if h is not a valid handle.
+ */
+void * hlock(Handle h);
+
+/**
+ * @name    hunlock
+ * @brief   Releases one lock on the block of handle h. Pointers from hlock must not be
+ *          used after the last unlock.
+ */
+void hunlock(Handle h);
+
+/**
+ * @name    hcompact
+ * @brief   Moves unlocked handle blocks down over free space, copying at most max_bytes.
+ *          Blocks from simple_malloc and locked blocks stay where they are.
+ * @retval  What was moved, and the free space before and after.
+ */
+CompactStats hcompact(size_t max_bytes);
+
+#endif /* MM_HANDLE_H */
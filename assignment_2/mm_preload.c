@@ -0,0 +1,196 @@
+/**
+ * @file   mm_preload.c
+ * @brief  malloc/free interposition library on top of the simple heap.
+ *
+ * Build with "make libsimplemalloc.so" and run an unmodified program with
+ *
+ *   LD_PRELOAD=./libsimplemalloc.so program
+ *
+ * All calls are serialized by one mutex. Allocations made while the calling
+ * thread is already inside the allocator (e.g. by atexit when the trace
+ * recorder starts) are served from a small static bootstrap arena which is
+ * never freed. Pointers that belong to neither the heap nor the arena (such
+ * as memory handed out by the dynamic loader before this library took over)
+ * are ignored by free and handed to the next realloc in the lookup order,
+ * normally glibc's, by realloc.
+ *
+ * Blocks are returned 16 byte aligned like glibc does, using simple_memalign.
+ */
+
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+
+#define MALLOC_ALIGN     16
+#define BOOTSTRAP_SIZE   (64 * 1024)
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread int in_heap __attribute__((tls_model("initial-exec")));
+
+static _Alignas(MALLOC_ALIGN) char bootstrap[BOOTSTRAP_SIZE];
+static size_t bootstrap_used = 0;
+
+
+static int in_bootstrap(void *ptr) {
+  return (char *) ptr >= bootstrap && (char *) ptr < bootstrap + BOOTSTRAP_SIZE;
+}
+
+static int in_simple_heap(void *ptr) {
+  return (uintptr_t) ptr >= memory_start && (uintptr_t) ptr < memory_end;
+}
+
+static void * bootstrap_alloc(size_t size) {
+  size_t offset = __atomic_fetch_add(&bootstrap_used, (size + MALLOC_ALIGN - 1) & ~(size_t) (MALLOC_ALIGN - 1), __ATOMIC_RELAXED);
+  if (offset + size > BOOTSTRAP_SIZE) return NULL;
+  return bootstrap + offset;
+}
+
+/* Gives memory aligned like glibc malloc when realloc moved a block; called with the lock held */
+static void * realign_locked(void *ptr, size_t size) {
+  if (((uintptr_t) ptr & (MALLOC_ALIGN - 1)) == 0) return ptr;
+
+  void *aligned = simple_memalign(MALLOC_ALIGN, size);
+  if (aligned == NULL) return ptr;   // Still usable, just less aligned
+
+  memcpy(aligned, ptr, size);
+  simple_free(ptr);
+  return aligned;
+}
+
+/* Reallocates a block that is not ours with the realloc this library hides */
+static void * foreign_realloc(void *ptr, size_t size) {
+  static void * (*next_realloc)(void *, size_t);
+
+  if (next_realloc == NULL) {
+    next_realloc = (void * (*)(void *, size_t)) dlsym(RTLD_NEXT, "realloc");
+    if (next_realloc == NULL) {
+      fprintf(stderr, "libsimplemalloc: realloc of foreign pointer %p, and no other realloc found\n", ptr);
+      abort();
+    }
+  }
+  return next_realloc(ptr, size);
+}
+
+/* Takes the heap lock unless this thread already holds it; returns 0 in that case */
+static int lock_heap(void) {
+  if (in_heap) return 0;
+  pthread_mutex_lock(&heap_lock);
+  in_heap = 1;
+  return 1;
+}
+
+static void unlock_heap(void) {
+  in_heap = 0;
+  pthread_mutex_unlock(&heap_lock);
+}
+
+
+static void * allocate(size_t align, size_t size) {
+  if (!lock_heap()) return bootstrap_alloc(size);
+  void *ptr = simple_memalign(align, size);
+  unlock_heap();
+  if (ptr == NULL) errno = ENOMEM;
+  return ptr;
+}
+
+void * malloc(size_t size) {
+  return allocate(MALLOC_ALIGN, size);
+}
+
+void free(void *ptr) {
+  if (ptr == NULL || in_bootstrap(ptr)) return;
+  if (!lock_heap()) return;   // Leak rather than deadlock
+  if (in_simple_heap(ptr)) simple_free(ptr);
+  unlock_heap();
+}
+
+void * calloc(size_t n, size_t size) {
+  if (size != 0 && n > SIZE_MAX / size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (!lock_heap()) return bootstrap_alloc(n * size);  // The bootstrap arena is zero already
+
+  void *ptr = simple_calloc_aligned(MALLOC_ALIGN, n, size);
+  unlock_heap();
+  if (ptr == NULL) errno = ENOMEM;
+  return ptr;
+}
+
+void * realloc(void *ptr, size_t size) {
+  if (ptr == NULL) return malloc(size);
+  if (size == 0) {
+    free(ptr);
+    return NULL;
+  }
+
+  if (in_bootstrap(ptr)) {
+    // Size of the old block is unknown; copy what can safely be read
+    void *new_ptr = malloc(size);
+    if (new_ptr != NULL) {
+      size_t avail = bootstrap + BOOTSTRAP_SIZE - (char *) ptr;
+      memcpy(new_ptr, ptr, avail < size ? avail : size);
+    }
+    return new_ptr;
+  }
+  if (!in_simple_heap(ptr)) return foreign_realloc(ptr, size);
+
+  if (!lock_heap()) return NULL;
+
+  void *new_ptr = simple_realloc(ptr, size);
+  if (new_ptr != NULL) new_ptr = realign_locked(new_ptr, size);
+
+  unlock_heap();
+  if (new_ptr == NULL) errno = ENOMEM;
+  return new_ptr;
+}
+
+int posix_memalign(void **out, size_t align, size_t size) {
+  if (align < sizeof(void *) || (align & (align - 1)) != 0) return EINVAL;
+  void *ptr = allocate(align < MALLOC_ALIGN ? MALLOC_ALIGN : align, size);
+  if (ptr == NULL) return ENOMEM;
+  *out = ptr;
+  return 0;
+}
+
+void * aligned_alloc(size_t align, size_t size) {
+  if (align == 0 || (align & (align - 1)) != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return allocate(align < MALLOC_ALIGN ? MALLOC_ALIGN : align, size);
+}
+
+void * memalign(size_t align, size_t size) {
+  return aligned_alloc(align, size);
+}
+
+void * valloc(size_t size) {
+  return aligned_alloc(4096, size);
+}
+
+size_t malloc_usable_size(void *ptr) {
+  if (ptr == NULL || !in_simple_heap(ptr)) return 0;
+  if (!lock_heap()) return 0;
+  size_t size = simple_usable_size(ptr);
+  unlock_heap();
+  return size;
+}
+
+
+/* Keep the heap consistent in a child created while another thread held the lock */
+static void before_fork(void) { pthread_mutex_lock(&heap_lock); }
+static void after_fork(void)  { pthread_mutex_unlock(&heap_lock); }
+
+__attribute__((constructor))
+static void preload_init(void) {
+  pthread_atfork(before_fork, after_fork, after_fork);
+}
@@ -0,0 +1,279 @@
+/**
+ * @file   mm_prof.c
+ * @brief  Sampling heap profiler for simple_malloc/simple_free (see mm_prof.h).
+ *
+ * Call stacks and live samples are kept in fixed size hash tables, and the
+ * profile is written with write(2), so that the profiler never calls malloc
+ * itself (apart from backtrace(), which loads libgcc on its first call from
+ * prof_init).
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <execinfo.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "mm_prof.h"
+
+#define PROF_MAX_DEPTH  32
+#define PROF_SITES      4096      // Distinct call stacks; further ones are counted in site 0
+#define PROF_LIVE       65536     // Live samples; further ones only count in the totals
+
+/* Totals for one call stack */
+typedef struct {
+  uint64_t hash;                  // 0 for an unused entry
+  uint32_t depth;
+  void *   frames[PROF_MAX_DEPTH];
+  uint64_t live_count;
+  uint64_t live_bytes;
+  uint64_t total_count;
+  uint64_t total_bytes;
+} ProfSite;
+
+/* A sampled allocation that has not been freed */
+typedef struct {
+  uintptr_t ptr;                  // 0 for an unused entry
+  uint32_t  site;
+  uint64_t  size;
+} ProfLive;
+
+int prof_enabled = 0;
+int64_t prof_countdown = 0;
+uint16_t prof_filter[PROF_FILTER_SIZE];
+
+static ProfSite sites[PROF_SITES];
+static ProfLive live[PROF_LIVE];
+static size_t num_live = 0;
+
+static size_t rate = PROF_DEFAULT_RATE;
+static uint64_t random_state = 0;
+static char profile_path[4096];
+static volatile sig_atomic_t dump_requested = 0;
+
+
+static uint64_t next_random(void) {
+  random_state ^= random_state >> 12;   // xorshift64*
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+  return random_state * 0x2545F4914F6CDD1Dull;
+}
+
+/* Draws the number of bytes until the next sample from an exponential distribution */
+static int64_t next_gap(void) {
+  double u = (double) ((next_random() >> 11) + 1) / 9007199254740992.0;   // (0, 1]
+  return (int64_t) (-log(u) * (double) rate) + 1;
+}
+
+static uint64_t hash_frames(void **frames, int depth) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (int i = 0; i < depth; i++) h = (h ^ (uintptr_t) frames[i]) * 0x100000001b3ull;
+  return h | 1;
+}
+
+static uint32_t find_site(void **frames, int depth) {
+  uint64_t h = hash_frames(frames, depth);
+
+  for (uint32_t i = h % (PROF_SITES - 1) + 1, n = 1; n < PROF_SITES; i = i % (PROF_SITES - 1) + 1, n++) {
+    ProfSite *s = &sites[i];
+    if (s->hash == 0) {
+      s->hash = h;
+      s->depth = depth;
+      memcpy(s->frames, frames, depth * sizeof(void *));
+      return i;
+    }
+    if (s->hash == h && s->depth == (uint32_t) depth && memcmp(s->frames, frames, depth * sizeof(void *)) == 0) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+static size_t live_slot(uintptr_t ptr) {
+  return (size_t) prof_bucket(ptr) * (PROF_LIVE / PROF_FILTER_SIZE);
+}
+
+static void live_insert(uintptr_t ptr, uint32_t site, uint64_t size) {
+  if (num_live >= PROF_LIVE * 3 / 4) return;
+
+  size_t i = live_slot(ptr);
+  while (live[i].ptr != 0) i = (i + 1) % PROF_LIVE;
+  live[i].ptr = ptr;
+  live[i].site = site;
+  live[i].size = size;
+  num_live++;
+  prof_filter[prof_bucket(ptr)]++;
+}
+
+/* Removes ptr from the live samples, filling the gap by shifting later entries back */
+static int live_remove(uintptr_t ptr, ProfLive *out) {
+  size_t i = live_slot(ptr);
+  while (live[i].ptr != ptr) {
+    if (live[i].ptr == 0) return 0;
+    i = (i + 1) % PROF_LIVE;
+  }
+  *out = live[i];
+  prof_filter[prof_bucket(ptr)]--;
+  num_live--;
+
+  for (size_t j = (i + 1) % PROF_LIVE; live[j].ptr != 0; j = (j + 1) % PROF_LIVE) {
+    size_t home = live_slot(live[j].ptr);
+    // Move entry j back to the gap unless its home slot lies between the gap and j
+    if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+      live[i] = live[j];
+      i = j;
+    }
+  }
+  live[i].ptr = 0;
+  return 1;
+}
+
+
+void prof_sample(void *ptr, size_t size) {
+  void *frames[PROF_MAX_DEPTH + 1];
+
+  if (dump_requested) {
+    dump_requested = 0;
+    simple_profile_dump(NULL);
+  }
+  prof_countdown = next_gap();
+
+  int depth = backtrace(frames, PROF_MAX_DEPTH + 1) - 1;   // Leave out prof_sample itself
+  uint32_t site = find_site(frames + 1, depth);
+
+  sites[site].live_count++;
+  sites[site].live_bytes += size;
+  sites[site].total_count++;
+  sites[site].total_bytes += size;
+  live_insert((uintptr_t) ptr, site, size);
+}
+
+void prof_free(void *ptr) {
+  ProfLive l;
+  if (!live_remove((uintptr_t) ptr, &l)) return;
+
+  sites[l.site].live_count--;
+  sites[l.site].live_bytes -= l.size;
+}
+
+void prof_moved(void *from, void *to) {
+  ProfLive l;
+  if (live_remove((uintptr_t) from, &l)) live_insert((uintptr_t) to, l.site, l.size);
+}
+
+
+static void request_dump(int sig) {
+  dump_requested = 1;
+}
+
+static void dump_at_exit(void) {
+  if (prof_enabled) simple_profile_dump(NULL);
+}
+
+void prof_init(void) {
+  static int initialized = 0;
+  const char *path = getenv("SIMPLE_PROFILE");
+  if (path == NULL || *path == '\0' || initialized) return;
+
+  initialized = 1;
+  const char *r = getenv("SIMPLE_PROFILE_RATE");
+  simple_profile(path, r != NULL ? strtoul(r, NULL, 10) : 0);
+}
+
+
+void simple_profile(const char *path, size_t sample_rate) {
+  if (path == NULL) {
+    prof_enabled = 0;
+    return;
+  }
+
+  size_t len = strlen(path);
+  if (len >= sizeof(profile_path)) return;
+  memcpy(profile_path, path, len + 1);
+
+  if (random_state == 0) {
+    void *warm_up[1];
+    backtrace(warm_up, 1);   // Loads libgcc now rather than inside an allocation
+    random_state = ((uint64_t) time(NULL) << 20) ^ (uintptr_t) &random_state ^ (uint64_t) getpid();
+    random_state |= 1;
+
+    // The profile is written at exit and on SIGUSR2, however profiling was started
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = request_dump;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR2, &sa, NULL);
+    atexit(dump_at_exit);
+  }
+
+  rate = sample_rate ? sample_rate : PROF_DEFAULT_RATE;
+  prof_countdown = next_gap();
+  prof_enabled = 1;
+}
+
+
+/* Writes all of buf, retrying after short writes */
+static void write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n <= 0) return;
+    buf += n;
+    len -= n;
+  }
+}
+
+int simple_profile_dump(const char *path) {
+  char line[64 + PROF_MAX_DEPTH * 20];
+  uint64_t live_count = 0, live_bytes = 0, total_count = 0, total_bytes = 0;
+
+  if (path == NULL) path = profile_path;
+  if (*path == '\0') return -1;
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return -1;
+
+  for (int i = 0; i < PROF_SITES; i++) {
+    live_count += sites[i].live_count;
+    live_bytes += sites[i].live_bytes;
+    total_count += sites[i].total_count;
+    total_bytes += sites[i].total_bytes;
+  }
+
+  int len = snprintf(line, sizeof(line), "heap profile: %6lu: %8lu [%6lu: %8lu] @ heap_v2/%zu\n",
+                     (unsigned long) live_count, (unsigned long) live_bytes,
+                     (unsigned long) total_count, (unsigned long) total_bytes, rate);
+  write_all(fd, line, len);
+
+  for (int i = 0; i < PROF_SITES; i++) {
+    ProfSite *s = &sites[i];
+    if (s->total_count == 0) continue;
+
+    len = snprintf(line, sizeof(line), "%6lu: %8lu [%6lu: %8lu] @",
+                   (unsigned long) s->live_count, (unsigned long) s->live_bytes,
+                   (unsigned long) s->total_count, (unsigned long) s->total_bytes);
+    for (uint32_t f = 0; f < s->depth; f++) {
+      len += snprintf(line + len, sizeof(line) - len, " %p", s->frames[f]);
+    }
+    line[len++] = '\n';
+    write_all(fd, line, len);
+  }
+
+  // pprof needs the mappings to symbolize the addresses
+  write_all(fd, "\nMAPPED_LIBRARIES:\n", 19);
+  int maps = open("/proc/self/maps", O_RDONLY);
+  if (maps >= 0) {
+    ssize_t n;
+    while ((n = read(maps, line, sizeof(line))) > 0) write_all(fd, line, n);
+    close(maps);
+  }
+
+  close(fd);
+  return 0;
+}
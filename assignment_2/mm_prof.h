@@ -0,0 +1,58 @@
+/**
+ * @file   mm_prof.h
+ * @brief  Sampling heap profiler for simple_malloc/simple_free.
+ *
+ * Allocations are sampled about once every SIMPLE_PROFILE_RATE bytes
+ * (512 KB by default), with exponentially distributed gaps so that every
+ * allocated byte is equally likely to be sampled. A sample records the call
+ * stack, and per call stack the profiler keeps the number and size of
+ * sampled allocations that are still live and of all sampled allocations.
+ *
+ * Profiling is enabled by setting the environment variable SIMPLE_PROFILE to
+ * the name of the profile file before the first call to simple_malloc, or by
+ * calling simple_profile(). The profile is written at exit, on SIGUSR2 (at
+ * the next sample) and by simple_profile_dump(), in the text heap profile
+ * format of gperftools, which pprof reads and scales back to whole-heap
+ * estimates (pprof --text program profile).
+ */
+
+#ifndef MM_PROF_H
+#define MM_PROF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROF_DEFAULT_RATE   (512 * 1024)
+
+/* Set while profiling; checked by mm.c before calling into the profiler */
+extern int prof_enabled;
+
+/* Bytes left until the next sample */
+extern int64_t prof_countdown;
+
+/* Nonzero entries mark buckets that may hold a sampled pointer (see prof_bucket) */
+extern uint16_t prof_filter[];
+
+#define PROF_FILTER_SIZE    4096
+#define prof_bucket(ptr)    ((((uintptr_t) (ptr) >> 3) * 0x9E3779B97F4A7C15ull) >> 52)
+
+#define PROF_MALLOC(ptr, size) \
+  do { if (prof_enabled && (prof_countdown -= (int64_t) (size)) < 0) prof_sample(ptr, size); } while (0)
+
+/* Not gated on prof_enabled: samples taken before profiling was stopped stay live until freed */
+#define PROF_FREE(ptr) \
+  do { if (prof_filter[prof_bucket(ptr)]) prof_free(ptr); } while (0)
+
+/* Starts profiling if SIMPLE_PROFILE is set. Called once when the heap is initialized. */
+void prof_init(void);
+
+/* Records a sample for the allocation at ptr and draws the next sampling gap */
+void prof_sample(void *ptr, size_t size);
+
+/* Removes the sample for ptr from the live totals, if ptr was sampled */
+void prof_free(void *ptr);
+
+/* Moves the sample for a block that compaction moved from from to to */
+void prof_moved(void *from, void *to);
+
+#endif /* MM_PROF_H */
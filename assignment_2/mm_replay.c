@@ -0,0 +1,202 @@
+/**
+ * @file   mm_replay.c
+ * @brief  Replays an allocation trace (see mm_trace.h) against an allocator backend.
+ *
+ * Usage: mm_replay [-a backend] [-i interval] trace_file
+ *
+ * Every interval operations a timeline row "ops footprint fragmentation" is
+ * printed, followed by a summary line of key=value pairs at the end.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mm_backend.h"
+#include "mm_trace.h"
+
+
+/* Open addressing map from trace id to the pointer returned by the backend */
+typedef struct {
+  uint64_t *keys;     // id + 1, 0 marks an empty slot
+  void    **values;
+  size_t    mask;
+} IdMap;
+
+static size_t id_hash(uint64_t key, size_t mask) {
+  return (size_t) (key * 0x9E3779B97F4A7C15ull >> 17) & mask;
+}
+
+static void map_put(IdMap *m, uint64_t id, void *ptr) {
+  size_t i = id_hash(id + 1ull, m->mask);
+  while (m->keys[i] != 0 && m->keys[i] != id + 1ull) i = (i + 1) & m->mask;
+  m->keys[i] = id + 1ull;
+  m->values[i] = ptr;
+}
+
+static void * map_take(IdMap *m, uint64_t id) {
+  size_t i = id_hash(id + 1ull, m->mask);
+  while (m->keys[i] != id + 1ull) {
+    if (m->keys[i] == 0) return NULL;
+    i = (i + 1) & m->mask;
+  }
+  void *ptr = m->values[i];
+
+  // Backward shift deletion keeps probe sequences intact without tombstones
+  size_t j = i;
+  m->keys[i] = 0;
+  for (;;) {
+    j = (j + 1) & m->mask;
+    if (m->keys[j] == 0) break;
+    size_t h = id_hash(m->keys[j], m->mask);
+    if ((j > i && (h <= i || h > j)) || (j < i && h <= i && h > j)) {
+      m->keys[i] = m->keys[j];
+      m->values[i] = m->values[j];
+      m->keys[j] = 0;
+      i = j;
+    }
+  }
+  return ptr;
+}
+
+static void print_backends(void) {
+  const AllocBackend *b;
+  fprintf(stderr, "Backends:");
+  for (size_t i = 0; (b = alloc_backend_at(i)) != NULL; i++) fprintf(stderr, " %s", b->name);
+  fprintf(stderr, "\n");
+}
+
+static double seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Reads the next record, widening it if the trace is in the old format */
+static int read_record(FILE *f, int v1, TraceRecord *r) {
+  if (!v1) return fread(r, sizeof(TraceRecord), 1, f) == 1;
+
+  TraceRecordV1 old;
+  if (fread(&old, sizeof(old), 1, f) != 1) return 0;
+  r->op = old.op;
+  r->size = old.size;
+  r->id = old.id;
+  r->time_ns = old.time_ns;
+  return 1;
+}
+
+/* Reads all records of a trace; NULL with errno set if it cannot be read or does not fit in memory */
+static TraceRecord * load_trace(const char *path, size_t *count) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) return NULL;
+
+  char magic[sizeof(TRACE_MAGIC) - 1];
+  if (fread(magic, 1, sizeof(magic), f) != sizeof(magic)) magic[0] = '\0';
+  int v1 = memcmp(magic, TRACE_MAGIC_V1, sizeof(magic)) == 0;
+  if (!v1 && memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+    fclose(f);
+    errno = EINVAL;
+    return NULL;
+  }
+
+  size_t capacity = 1024, n = 0;
+  TraceRecord *records = malloc(capacity * sizeof(TraceRecord));
+  while (records != NULL && read_record(f, v1, &records[n])) {
+    if (++n == capacity) {
+      capacity *= 2;
+      TraceRecord *grown = realloc(records, capacity * sizeof(TraceRecord));
+      if (grown == NULL) free(records);
+      records = grown;
+    }
+  }
+  fclose(f);
+  if (records == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  *count = n;
+  return records;
+}
+
+int main(int argc, char **argv) {
+  const char *name = "simple";
+  size_t interval = 1000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "a:i:")) != -1) {
+    switch (opt) {
+      case 'a': name = optarg; break;
+      case 'i': interval = strtoul(optarg, NULL, 10); break;
+      default:  optind = argc + 1;
+    }
+  }
+  if (optind != argc - 1 || interval == 0) {
+    fprintf(stderr, "Usage: %s [-a backend] [-i interval] trace_file\n", argv[0]);
+    print_backends();
+    return 2;
+  }
+
+  const AllocBackend *backend = alloc_backend(name);
+  if (backend == NULL) {
+    fprintf(stderr, "Unknown backend %s\n", name);
+    print_backends();
+    return 2;
+  }
+
+  size_t count;
+  TraceRecord *records = load_trace(argv[optind], &count);
+  if (records == NULL) {
+    fprintf(stderr, "Could not read trace %s: %s\n", argv[optind], strerror(errno));
+    return 1;
+  }
+
+  IdMap map;
+  map.mask = 1;
+  while (map.mask < 2 * count) map.mask <<= 1;
+  map.keys = calloc(map.mask, sizeof(uint64_t));
+  map.values = malloc(map.mask * sizeof(void *));
+  map.mask--;
+
+  if (backend->init) backend->init();
+  size_t base = backend->footprint();
+  size_t peak = 0, failed = 0;
+  double busy = 0.0;
+
+  printf("# ops footprint fragmentation\n");
+  for (size_t n = 0; n < count; n++) {
+    TraceRecord *r = &records[n];
+    double t = seconds();
+
+    if (r->op == TRACE_MALLOC) {
+      void *ptr = backend->malloc(r->size);
+      busy += seconds() - t;
+      if (ptr == NULL) failed++;
+      else map_put(&map, r->id, ptr);
+    } else {
+      void *ptr = map_take(&map, r->id);
+      if (ptr != NULL) backend->free(ptr);
+      busy += seconds() - t;
+    }
+
+    size_t footprint = backend->footprint() - base;
+    if (footprint > peak) peak = footprint;
+    if ((n + 1) % interval == 0) {
+      printf("%zu %zu %.4f\n", n + 1, footprint, backend->fragmentation());
+    }
+  }
+
+  printf("backend=%s ops=%zu failed=%zu seconds=%.6f ops_per_sec=%.0f peak_footprint=%zu fragmentation=%.4f\n",
+         backend->name, count, failed, busy, busy > 0 ? count / busy : 0.0, peak, backend->fragmentation());
+
+  free(map.keys);
+  free(map.values);
+  free(records);
+  return 0;
+}
@@ -0,0 +1,191 @@
+/**
+ * @file   mm_small.c
+ * @brief  Headerless size-class pages for small objects (see mm_small.h).
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "mm.h"
+#include "mm_small.h"
+
+#define SMALL_PAGE_SHIFT  12
+#define SMALL_PAGE_SIZE   ((uintptr_t)1 << SMALL_PAGE_SHIFT)
+#define SLOT_WORDS        8     // Enough bitmap for SMALL_PAGE_SIZE / 8 slots
+#define FIRST_SLOT        128   // Offset of the first object; the descriptor fits in front of it
+#define CHUNK_PAGES       16    // Pages carved from one heap block, so that they share one alignment hole
+
+/* Page descriptor at the start of every size-class page */
+typedef struct small_page {
+  struct small_page *next;      // Pages of the same class with free slots
+  struct small_page *prev;
+  uint16_t size;                // Object size of the class
+  uint16_t capacity;            // Number of slots in the page
+  uint16_t used;                // Number of slots in use
+  uint8_t  class;               // Index into class_sizes
+  uint16_t chunk_pages;         // In the first page of a chunk: pages in the chunk
+  uint16_t chunk_free;          // In the first page of a chunk: pages of the chunk not in use
+  struct small_page *chunk;     // First page of the chunk, which is the heap block
+  uint64_t slots[SLOT_WORDS];   // Bit set for slots in use
+} SmallPage;
+
+static const uint16_t class_sizes[] = { 8, 16, 24, 32, 48, 64, 96, 128, 192, 256 };
+
+#define NUM_CLASSES  (sizeof(class_sizes) / sizeof(class_sizes[0]))
+
+int small_enabled = 0;
+
+static SmallPage *partial[NUM_CLASSES];   // Pages with at least one free slot
+static SmallPage *free_pages = NULL;      // Pages of chunks not in use by any class, linked by next/prev
+static uint64_t *small_pages = NULL;      // One bit per heap page, set for size-class pages
+static size_t num_small_pages = 0;
+static size_t num_objects = 0;
+
+static size_t page_index(uintptr_t addr) {
+  return (addr >> SMALL_PAGE_SHIFT) - (memory_start >> SMALL_PAGE_SHIFT);
+}
+
+static int class_of(size_t size) {
+  int c = 0;
+  while (class_sizes[c] < size) c++;
+  return c;
+}
+
+static void list_remove(SmallPage *page) {
+  if (page->prev) page->prev->next = page->next;
+  else partial[page->class] = page->next;
+  if (page->next) page->next->prev = page->prev;
+  page->next = page->prev = NULL;
+}
+
+static void list_push(SmallPage *page) {
+  page->prev = NULL;
+  page->next = partial[page->class];
+  if (page->next) page->next->prev = page;
+  partial[page->class] = page;
+}
+
+static void free_pages_push(SmallPage *page) {
+  page->prev = NULL;
+  page->next = free_pages;
+  if (page->next) page->next->prev = page;
+  free_pages = page;
+}
+
+static void free_pages_remove(SmallPage *page) {
+  if (page->prev) page->prev->next = page->next;
+  else free_pages = page->next;
+  if (page->next) page->next->prev = page->prev;
+}
+
+/* Carves a new chunk into free pages; takes fewer pages when the heap has no room for all */
+static int new_chunk(void) {
+  for (size_t n = CHUNK_PAGES; n > 0; n /= 2) {
+    SmallPage *chunk = block_alloc(SMALL_PAGE_SIZE, n * SMALL_PAGE_SIZE, 0);
+    if (chunk == NULL) continue;
+
+    chunk->chunk_pages = chunk->chunk_free = n;
+    for (size_t i = n; i-- > 0; ) {
+      SmallPage *page = (SmallPage *)((uintptr_t)chunk + i * SMALL_PAGE_SIZE);
+      page->chunk = chunk;
+      free_pages_push(page);
+    }
+    return 1;
+  }
+  return 0;
+}
+
+/* Returns a page that no class uses any more, giving its chunk back once all of it is unused */
+static void release_page(SmallPage *page) {
+  SmallPage *chunk = page->chunk;
+
+  free_pages_push(page);
+  if (++chunk->chunk_free < chunk->chunk_pages) return;
+
+  for (size_t i = 0; i < chunk->chunk_pages; i++) {
+    free_pages_remove((SmallPage *)((uintptr_t)chunk + i * SMALL_PAGE_SIZE));
+  }
+  simple_free(chunk);
+}
+
+static SmallPage * new_page(int c) {
+  if (small_pages == NULL) {
+    size_t bits = page_index(memory_end - 1) + 1;
+    small_pages = block_alloc(sizeof(uint64_t), (bits + 63) / 64 * sizeof(uint64_t), 1);   // Not a small object itself
+    if (small_pages == NULL) return NULL;
+  }
+
+  if (free_pages == NULL && !new_chunk()) return NULL;
+
+  SmallPage *page = free_pages;
+  free_pages_remove(page);
+  page->chunk->chunk_free--;
+
+  page->used = 0;
+  memset(page->slots, 0, sizeof(page->slots));
+  page->class = c;
+  page->size = class_sizes[c];
+  page->capacity = (SMALL_PAGE_SIZE - FIRST_SLOT) / page->size;
+
+  size_t i = page_index((uintptr_t)page);
+  small_pages[i / 64] |= (uint64_t)1 << (i % 64);
+  num_small_pages++;
+
+  list_push(page);
+  return page;
+}
+
+void * small_alloc(size_t size) {
+  int c = class_of(size);
+  SmallPage *page = partial[c];
+
+  if (page == NULL && (page = new_page(c)) == NULL) return NULL;
+
+  // First free slot; slots past capacity are never free since a full page leaves the list
+  int w = 0;
+  while (page->slots[w] == ~(uint64_t)0) w++;
+  int slot = w * 64 + __builtin_ctzll(~page->slots[w]);
+
+  page->slots[w] |= (uint64_t)1 << (slot % 64);
+  page->used++;
+  num_objects++;
+  if (page->used == page->capacity) list_remove(page);
+
+  return (void *)((uintptr_t)page + FIRST_SLOT + (uintptr_t)slot * page->size);
+}
+
+void small_free(void *ptr) {
+  SmallPage *page = (SmallPage *)((uintptr_t)ptr & ~(SMALL_PAGE_SIZE - 1));
+  size_t slot = ((uintptr_t)ptr - (uintptr_t)page - FIRST_SLOT) / page->size;
+  uint64_t bit = (uint64_t)1 << (slot % 64);
+
+  if (!(page->slots[slot / 64] & bit)) return;   // Not in use; avoid double free
+
+  page->slots[slot / 64] &= ~bit;
+  num_objects--;
+  if (page->used-- == page->capacity) list_push(page);
+
+  // Give empty pages back to the heap, but keep one per class to avoid thrashing
+  if (page->used == 0 && (page->next != NULL || page->prev != NULL)) {
+    list_remove(page);
+    size_t i = page_index((uintptr_t)page);
+    small_pages[i / 64] &= ~((uint64_t)1 << (i % 64));
+    num_small_pages--;
+    release_page(page);
+  }
+}
+
+int small_owns(void *ptr) {
+  if (small_pages == NULL || (uintptr_t)ptr < memory_start || (uintptr_t)ptr >= memory_end) return 0;
+  size_t i = page_index((uintptr_t)ptr);
+  return (small_pages[i / 64] >> (i % 64)) & 1;
+}
+
+size_t small_size(void *ptr) {
+  return ((SmallPage *)((uintptr_t)ptr & ~(SMALL_PAGE_SIZE - 1)))->size;
+}
+
+void small_counts(size_t *pages, size_t *objects) {
+  *pages = num_small_pages;
+  *objects = num_objects;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file   mm_small.h
+ * @brief  Size-class pages for small objects, used by mm.c when enabled with
+ *         simple_small_objects().
+ *
+ * Each page holds objects of a single size class without block headers. The
+ * page descriptor with the size class and the slot bitmap sits at the start
+ * of the page, so it is found by page-aligning an object pointer. Pages are
+ * carved from chunks of up to 16 contiguous pages allocated from the simple
+ * heap, so that the alignment hole in front of a chunk is shared by all its
+ * pages. A chunk is given back once none of its pages is in use. A bitmap
+ * with one bit per heap page tells whether a pointer belongs to a size-class
+ * page.
+ */
+
+#ifndef MM_SMALL_H
+#define MM_SMALL_H
+
+#include <stddef.h>
+
+#define SMALL_MAX_SIZE   256    // Largest request served from size-class pages
+
+/* Set while small objects are enabled; checked by mm.c before calling small_alloc */
+extern int small_enabled;
+
+/* Allocates an object of at least size (<= SMALL_MAX_SIZE) bytes, NULL if no page could be had */
+void * small_alloc(size_t size);
+
+/* Frees an object for which small_owns() is true */
+void small_free(void *ptr);
+
+/* Tells whether ptr lies in a size-class page */
+int small_owns(void *ptr);
+
+/* Gives the object size of the size class that ptr belongs to */
+size_t small_size(void *ptr);
+
+/* Gives the number of size-class pages and live small objects */
+void small_counts(size_t *pages, size_t *objects);
+
+/* Allocates a block from the block list, never from size-class pages; provided by mm.c */
+void * block_alloc(size_t align, size_t size, int zero);
+
+#endif /* MM_SMALL_H */
@@ -0,0 +1,76 @@
+/**
+ * @file   mm_trace.c
+ * @brief  Allocation trace recorder for simple_malloc/simple_free.
+ *
+ * Records are buffered and written with write(2) so that recording never
+ * calls malloc itself.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "mm_trace.h"
+
+#define TRACE_BUFFER_RECORDS  4096
+
+int trace_enabled = 0;
+
+static int trace_fd = -1;
+static TraceRecord buffer[TRACE_BUFFER_RECORDS];
+static int buffered = 0;
+static uint64_t start_ns;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+void trace_init(void) {
+  const char *path = getenv("SIMPLE_TRACE");
+  if (path == NULL || *path == '\0' || trace_fd >= 0) return;
+
+  trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (trace_fd < 0) return;
+
+  if (write(trace_fd, TRACE_MAGIC, strlen(TRACE_MAGIC)) < 0) {
+    close(trace_fd);
+    trace_fd = -1;
+    return;
+  }
+
+  start_ns = now_ns();
+  trace_enabled = 1;
+  atexit(simple_trace_flush);
+}
+
+void trace_record(uint8_t op, void *ptr, size_t size) {
+  TraceRecord *r = &buffer[buffered++];
+
+  r->op = op;
+  r->size = size;
+  r->id = ((uintptr_t) ptr - memory_start) >> 3;  // Blocks are 8 byte aligned
+  r->time_ns = now_ns() - start_ns;
+
+  if (buffered == TRACE_BUFFER_RECORDS) simple_trace_flush();
+}
+
+void simple_trace_flush(void) {
+  if (trace_fd < 0 || buffered == 0) return;
+
+  const char *p = (const char *) buffer;
+  size_t left = buffered * sizeof(TraceRecord);
+  while (left > 0) {
+    ssize_t n = write(trace_fd, p, left);
+    if (n <= 0) break;
+    p += n;
+    left -= n;
+  }
+  buffered = 0;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file   mm_trace.h
+ * @brief  Binary allocation trace format shared by the recorder and mm_replay.
+ *
+ * A trace file starts with TRACE_MAGIC followed by a sequence of TraceRecords.
+ * Traces written before the fields were widened start with TRACE_MAGIC_V1 and
+ * hold TraceRecordV1s; mm_replay reads both.
+ * Recording is enabled by setting the environment variable SIMPLE_TRACE to the
+ * name of the file to write before the first call to simple_malloc.
+ *
+ * Sample traces recorded from cmd_int and the check_mm test suite (which is
+ * dominated by test_memory_exerciser) are found in traces/.
+ */
+
+#ifndef MM_TRACE_H
+#define MM_TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAGIC     "SMTRACE2"     // 8 byte file header
+#define TRACE_MAGIC_V1  "SMTRACE1"
+#define TRACE_MALLOC    'm'
+#define TRACE_FREE      'f'
+
+/* One traced operation (25 bytes on disk) */
+typedef struct __attribute__((packed)) {
+  uint8_t  op;        // TRACE_MALLOC or TRACE_FREE
+  uint64_t size;      // Requested size (0 for free)
+  uint64_t id;        // Identifies the block; equal for a malloc and its matching free
+  uint64_t time_ns;   // Nanoseconds since recording started
+} TraceRecord;
+
+/* One traced operation in a TRACE_MAGIC_V1 file (17 bytes on disk) */
+typedef struct __attribute__((packed)) {
+  uint8_t  op;
+  uint32_t size;
+  uint32_t id;
+  uint64_t time_ns;
+} TraceRecordV1;
+
+/* Set when a trace is being recorded; checked by mm.c before calling trace_record */
+extern int trace_enabled;
+
+/* Starts recording if SIMPLE_TRACE is set. Called once when the heap is initialized. */
+void trace_init(void);
+
+/* Appends one record for the block at ptr. */
+void trace_record(uint8_t op, void *ptr, size_t size);
+
+#endif /* MM_TRACE_H */
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mm_buddy.h"
+
+
+/**
+ * Test program for the buddy allocator. It runs in a process of its own,
+ * since the buddy allocator and simple_malloc share the memory region.
+ */
+
+#define BLOCKS 64
+
+int main(int argc, char ** argv) {
+  void * p[BLOCKS];
+  int i;
+
+  /* Power-of-two requests of all sizes; blocks must not overlap */
+  for (i = 0; i < BLOCKS; i++) {
+    size_t size = (size_t) 16 << (i % 12);
+    p[i] = buddy_malloc(size);
+    if (p[i] == NULL || ((uintptr_t) p[i] & 7)) {
+      printf("Allocation %d of %zu bytes failed\n", i, size);
+      return 1;
+    }
+    memset(p[i], i, size);
+  }
+
+  for (i = 0; i < BLOCKS; i++) {
+    size_t size = (size_t) 16 << (i % 12);
+    for (size_t j = 0; j < size; j++) {
+      if (((uint8_t *) p[i])[j] != i) {
+        printf("Block %d overwritten\n", i);
+        return 1;
+      }
+    }
+  }
+
+  /* Free in an interleaved order; everything must merge back */
+  for (i = 0; i < BLOCKS; i += 2) buddy_free(p[i]);
+  for (i = 1; i < BLOCKS; i += 2) buddy_free(p[i]);
+
+  HeapStats s = buddy_heap_stats();
+  if (s.used_blocks != 0 || s.bytes_in_use != 0) {
+    printf("%zu blocks still in use\n", s.used_blocks);
+    return 1;
+  }
+  if (s.splits != s.coalesces) {
+    printf("Blocks not merged: %lu splits, %lu merges\n", s.splits, s.coalesces);
+    return 1;
+  }
+
+  /* The largest block must be whole again */
+  void * big = buddy_malloc(s.largest_free - 8);
+  if (big == NULL) {
+    printf("Largest block of %zu bytes not available\n", s.largest_free);
+    return 1;
+  }
+  buddy_free(big);
+
+  printf("Buddy test passed: %lu allocations, %lu splits, %lu merges, largest free block %zu\n",
+         s.allocs, s.splits, s.coalesces, s.largest_free);
+  return 0;
+}
@@ -0,0 +1,111 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "mm.h"
+
+
+/**
+ * Test program for the persistent heap. A child process builds a linked list
+ * in a heap file and exits; the parent then opens the same file and must find
+ * the list through the root object, with all pointers still valid.
+ */
+
+#define NODES       1000
+#define HEAP_SIZE   (8 * 1024 * 1024)
+#define BIG_SIZE    (1024 * 1024)
+
+typedef struct node {
+  struct node * next;
+  int value;
+  char text[20];
+} Node;
+
+static int build(const char * path) {
+  if (simple_heap_open(path, HEAP_SIZE) != 0) return 1;
+
+  Node * list = NULL;
+  for (int i = 0; i < NODES; i++) {
+    Node * n = simple_malloc(sizeof(Node));
+    if (n == NULL) return 1;
+    n->next = list;
+    n->value = i;
+    snprintf(n->text, sizeof(n->text), "node %d", i);
+    list = n;
+  }
+  simple_heap_set_root(list);
+
+  /* A large freed block gives its pages back; they must read as zero later */
+  char * big = simple_malloc(BIG_SIZE);
+  if (big == NULL) return 1;
+  memset(big, 0xFF, BIG_SIZE);
+  simple_free(big);
+
+  return simple_heap_sync() != 0;
+}
+
+int main(int argc, char ** argv) {
+  char path[] = "/tmp/mm_persist_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  close(fd);
+
+  pid_t pid = fork();
+  if (pid == 0) exit(build(path));
+
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    printf("Building the heap file failed\n");
+    unlink(path);
+    return 1;
+  }
+
+  /* Warm restart: the list is found again through the root object */
+  int ret = 1;
+  if (simple_heap_open(path, 0) != 0) {
+    printf("Reopening the heap file failed\n");
+    goto out;
+  }
+
+  int count = 0;
+  char text[20];
+  for (Node * n = simple_heap_root(); n != NULL; n = n->next, count++) {
+    snprintf(text, sizeof(text), "node %d", NODES - 1 - count);
+    if (n->value != NODES - 1 - count || strcmp(n->text, text) != 0) {
+      printf("Node %d damaged\n", count);
+      goto out;
+    }
+  }
+  if (count != NODES || simple_heap_stats().used_blocks != NODES) {
+    printf("Found %d nodes, %zu used blocks\n", count, simple_heap_stats().used_blocks);
+    goto out;
+  }
+
+  char * zeroed = simple_calloc(1, BIG_SIZE);
+  if (zeroed == NULL) {
+    printf("Allocation after reopening failed\n");
+    goto out;
+  }
+  for (size_t i = 0; i < BIG_SIZE; i++) {
+    if (zeroed[i] != 0) {
+      printf("Byte %zu of calloc block not zero\n", i);
+      goto out;
+    }
+  }
+
+  printf("Persist test passed: %d nodes found at %p\n", count, simple_heap_root());
+  ret = 0;
+
+out:
+  unlink(path);
+  return ret;
+}
@@ -19,6 +19,17 @@ typedef char MsgKind;
 #define AQ_ALARM        1   // Message is of kind alarm
 #define AQ_NORMAL       0   // Message if of kind normal
 
+#define AQ_PRIORITIES   8   // Kinds of an AQ_PRIO queue are priority levels 0 .. AQ_PRIORITIES-1
+
+#define AQ_THROTTLE     1   // aq_send: sent, but the queue is above its high watermark
+#define AQ_DROPPED      2   // aq_send: not queued but freed, as the queue is full under AQ_DROP_NEWEST
+
+/* Overflow policies for aq_create_bounded */
+#define AQ_BLOCK        0   // aq_send waits until a normal message is received
+#define AQ_FAIL         1   // aq_send gives AQ_NO_ROOM
+#define AQ_DROP_OLDEST  2   // The oldest normal message is freed to make room
+#define AQ_DROP_NEWEST  3   // The message being sent is freed instead of queued
+
 /* Error codes */
 #define AQ_UNINIT      -1   // Queue has not been initialized
 #define AQ_NULL_MSG    -2   // Sent message is NULL
@@ -26,6 +37,12 @@ typedef char MsgKind;
 #define AQ_NO_ROOM     -4   // No room for message
 #define AQ_NOT_IMPL  -100   // Operation is not implemented
 
+/* Queue types for aq_create_ex */
+#define AQ_MPMC         0   // Any number of producer and consumer threads
+#define AQ_SPSC         1   // Exactly one producer thread and one consumer thread
+#define AQ_PRIO         2   // Like AQ_MPMC, but with AQ_PRIORITIES kinds and no limit on alarms
+#define AQ_SHARDED      3   // Like AQ_MPMC, but split into shards that receivers steal from
+
 typedef void * AlarmQueue;  // Opaque type 
 
 /**
@@ -35,10 +52,67 @@ typedef void * AlarmQueue;  // Opaque type
  */
 AlarmQueue aq_create( );
 
+/**
+ * @name    aq_create_ex
+ * @brief   Creates and initializes an alarm queue of the given type (AQ_MPMC, AQ_SPSC, AQ_PRIO
+ *          or AQ_SHARDED; the last has one shard per online CPU, see aq_create_sharded).
+ *          An AQ_SPSC queue must only be sent to by one thread and received from by one
+ *          thread. It holds at most 65536 normal messages; aq_send gives AQ_NO_ROOM when full.
+ *          An AQ_PRIO queue takes any kind from AQ_NORMAL to AQ_PRIORITIES-1 and holds any
+ *          number of each; aq_recv returns the oldest message of the highest kind present.
+ * @retval  Handle to alarm queue if created, otherwise NULL (also if the library lacks the type)
+ */
+AlarmQueue aq_create_ex(int type);
+
+/**
+ * @name    aq_create_sharded
+ * @brief   Creates an AQ_SHARDED queue of the given number of shards (one per online CPU if 0).
+ *          Each sending thread sends its normal messages to one shard and each receiving thread
+ *          receives from one, stealing from the others when its own is empty. The alarm skips
+ *          the shards, so it is received first. Normal messages are only received in the order
+ *          sent if they come from one thread and go to one thread.
+ * @retval  Handle to alarm queue if created, otherwise NULL
+ */
+AlarmQueue aq_create_sharded(int shards);
+
+/**
+ * @name    aq_create_bounded
+ * @brief   Creates an AQ_MPMC or AQ_PRIO queue holding at most limit normal messages. When a
+ *          normal message is sent at the limit, policy (AQ_BLOCK, AQ_FAIL, AQ_DROP_OLDEST or
+ *          AQ_DROP_NEWEST) decides what happens. Alarms and other kinds are never limited.
+ * @retval  Handle to alarm queue if created, otherwise NULL
+ */
+AlarmQueue aq_create_bounded(int type, int limit, int policy);
+
+/**
+ * @name    aq_set_watermarks
+ * @brief   Throttles senders once high normal messages are queued, until receivers have
+ *          brought the count down to low. A high of 0 turns throttling off.
+ * @retval  0 if set, otherwise an error code.
+ */
+int aq_set_watermarks( AlarmQueue aq, int high, int low);
+
+/**
+ * @name    aq_throttled
+ * @brief   Tells whether senders are throttled, i.e. the queue passed its high watermark
+ *          and has not yet been drained to its low watermark.
+ * @retval  1 if throttled, otherwise 0
+ */
+int aq_throttled( AlarmQueue aq);
+
+/**
+ * @name    aq_dropped
+ * @brief   Give number of messages dropped by the overflow policy
+ * @retval  Number of messages freed by AQ_DROP_OLDEST or AQ_DROP_NEWEST
+ */
+int aq_dropped( AlarmQueue aq);
+
 /**
  * @name    aq_send
  * @brief   Sends message pointed to by msg with kind indicated.
- * @retval  0 if message was successfully sent, otherwise an error code.
+ * @retval  0 if message was successfully sent, AQ_THROTTLE if it was sent while the queue is
+ *          above its high watermark, AQ_DROPPED if it was freed by AQ_DROP_NEWEST instead,
+ *          otherwise an error code.
  */
 int aq_send( AlarmQueue aq, void * msg, MsgKind k);
 
@@ -49,6 +123,40 @@ int aq_send( AlarmQueue aq, void * msg, MsgKind k);
  */
 int aq_recv( AlarmQueue aq, void * * msg);
 
+/**
+ * @name    aq_try_recv
+ * @brief   Receives a message like aq_recv, but returns at once if the queue is empty.
+ * @retval  Kind of message if a message was received, AQ_NO_MSG if the queue was empty,
+ *          otherwise an error code.
+ */
+int aq_try_recv( AlarmQueue aq, void * * msg);
+
+/**
+ * @name    aq_recv_timed
+ * @brief   Receives a message like aq_recv, but waits at most timeout_ns nanoseconds,
+ *          measured on CLOCK_MONOTONIC.
+ * @retval  Kind of message if a message was received, AQ_NO_MSG if none arrived in time,
+ *          otherwise an error code.
+ */
+int aq_recv_timed( AlarmQueue aq, void * * msg, long long timeout_ns);
+
+/**
+ * @name    aq_send_batch
+ * @brief   Sends the n normal messages of msgs in order, taking the lock and waking receivers once.
+ * @retval  Number of messages sent (fewer than n only if the queue ran out of room), otherwise an error code.
+ *          Messages freed by AQ_DROP_NEWEST count as sent.
+ */
+int aq_send_batch( AlarmQueue aq, void * * msgs, int n);
+
+/**
+ * @name    aq_recv_batch
+ * @brief   Receives up to max messages into out and their kinds into kinds, in the order aq_recv
+ *          would return them, so a pending alarm comes first. Blocks until a message is ready
+ *          (the sequential library returns AQ_NO_MSG instead).
+ * @retval  Number of messages received, otherwise an error code.
+ */
+int aq_recv_batch( AlarmQueue aq, void * * out, int max, MsgKind * kinds);
+
 /**
  * @name    aq_size
  * @brief   Give size of alarm queue in terms of messages
@@ -63,6 +171,31 @@ int aq_size( AlarmQueue aq);
  */
 int aq_alarms( AlarmQueue aq);
 
+/**
+ * @name    aq_count
+ * @brief   Give number of messages of one kind
+ * @retval  Number of messages of kind k currently held by the queue
+ */
+int aq_count( AlarmQueue aq, MsgKind k);
+
+/**
+ * @name    aq_fd
+ * @brief   Gives an eventfd that polls readable while the queue holds messages, so the queue
+ *          can be watched with epoll or poll and drained with aq_try_recv. It may stay readable
+ *          after the queue is emptied, until a receive finds it empty, so drain until AQ_NO_MSG.
+ *          Do not read from the fd; aq_destroy closes it.
+ * @retval  File descriptor, otherwise an error code.
+ */
+int aq_fd( AlarmQueue aq);
+
+/**
+ * @name    aq_alarm_fd
+ * @brief   Like aq_fd, but readable while an alarm (in an AQ_PRIO queue, any kind above
+ *          AQ_NORMAL) is pending. A receive that gets a normal message or none resets it.
+ * @retval  File descriptor, otherwise an error code.
+ */
+int aq_alarm_fd( AlarmQueue aq);
+
 void aq_destroy(AlarmQueue q);
 #endif /* LIBAQ_H_INCLUDED */
 
@@ -0,0 +1,227 @@
+/**
+ * @file   aq_bench.c
+ * @brief  Throughput benchmark for the thread-safe alarm queue libraries.
+ *
+ * Usage: bench_<lib> [-n messages] [-t max_threads] [-s] [-S] [-b batch] [-l]
+ *
+ * The same source is linked against each library (bench_tsafe with libaq.a,
+ * bench_lf with libaq_lf.a). For 1, 2, 4, ... max_threads producers and as
+ * many consumers, the producers share n normal messages between them and the
+ * consumers receive them all. Results are printed as a tab separated table
+ * with one header line.
+ *
+ * With -s the queue is created with aq_create_ex(AQ_SPSC) and only the
+ * single producer/single consumer round is run. With -S it is created with
+ * aq_create_sharded, with one shard per consumer. With -b the messages are
+ * sent and received with aq_send_batch and aq_recv_batch, batch at a time.
+ *
+ * With -l the alarm latency is measured instead: one consumer waits in
+ * aq_recv while n alarms (at most 100000) are sent 50 us apart, and the
+ * percentiles of the time from send to receive are printed together with
+ * the CPU time the process used.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+
+#include "aq.h"
+
+typedef struct {
+    int value;
+} Msg;
+
+typedef struct {
+    uint64_t sent_ns;
+} Stamp;
+
+static AlarmQueue q;
+static Msg* payload;       // Messages are preallocated so that malloc is not measured
+static Msg stop;           // Sent once to every consumer when the producers are done
+static long per_producer;
+static int queue_type = AQ_MPMC;
+static int batch = 1;      // Messages per aq_send_batch/aq_recv_batch call, or 1 for aq_send/aq_recv
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void* producer(void* arg) {
+    Msg* msgs = &payload[(intptr_t)arg * per_producer];
+    if (batch > 1) {
+        void* ptrs[batch];
+        for (long i = 0; i < per_producer; ) {
+            int n = per_producer - i < batch ? (int)(per_producer - i) : batch;
+            for (int j = 0; j < n; j++) ptrs[j] = &msgs[i + j];
+            int sent = aq_send_batch(q, ptrs, n);
+            if (sent == AQ_NO_ROOM) sched_yield();
+            else i += sent;
+        }
+        return NULL;
+    }
+    for (long i = 0; i < per_producer; i++) {
+        while (aq_send(q, &msgs[i], AQ_NORMAL) == AQ_NO_ROOM) {
+            sched_yield(); // Bounded queue is full; let the consumers catch up
+        }
+    }
+    return NULL;
+}
+
+static void* consumer(void* arg) {
+    long received = 0;
+    if (batch > 1) {
+        void* msgs[batch];
+        MsgKind kinds[batch];
+        int stops = 0;
+        while (!stops) {
+            int n = aq_recv_batch(q, msgs, batch, kinds);
+            for (int i = 0; i < n; i++) {
+                if (msgs[i] == &stop) stops++;
+                else received++;
+            }
+        }
+        while (--stops > 0) {
+            aq_send(q, &stop, AQ_NORMAL); // Hand back the stops meant for other consumers
+        }
+        return (void*)received;
+    }
+    void* msg;
+    while (aq_recv(q, &msg) >= 0 && msg != &stop) {
+        received++;
+    }
+    return (void*)received;
+}
+
+// Runs one round and returns the number of messages received per second
+static double run(int threads, long messages) {
+    pthread_t producers[threads], consumers[threads];
+    long received = 0;
+
+    per_producer = messages / threads;
+    q = queue_type == AQ_SHARDED ? aq_create_sharded(threads) : aq_create_ex(queue_type);
+
+    uint64_t start = now_ns();
+    for (intptr_t i = 0; i < threads; i++) {
+        pthread_create(&consumers[i], NULL, consumer, NULL);
+        pthread_create(&producers[i], NULL, producer, (void*)i);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(producers[i], NULL);
+    }
+    while (aq_size(q) > 0) {
+        sched_yield(); // A stop must not overtake messages left in another shard
+    }
+    for (int i = 0; i < threads; i++) {
+        while (aq_send(q, &stop, AQ_NORMAL) == AQ_NO_ROOM) sched_yield();
+    }
+    for (int i = 0; i < threads; i++) {
+        void* n;
+        pthread_join(consumers[i], &n);
+        received += (long)n;
+    }
+    double secs = (now_ns() - start) * 1e-9;
+
+    aq_destroy(q);
+    if (received != per_producer * threads) {
+        fprintf(stderr, "Received %ld of %ld messages\n", received, per_producer * threads);
+        exit(1);
+    }
+    return received / secs;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void* alarm_consumer(void* arg) {
+    uint64_t* latency = (uint64_t*)arg;
+    for (long i = 0; i < per_producer; i++) {
+        void* msg;
+        aq_recv(q, &msg);
+        latency[i] = now_ns() - ((Stamp*)msg)->sent_ns;
+    }
+    return NULL;
+}
+
+// Measures the time from sending an alarm to its receipt by a waiting consumer
+static void alarm_latency(long alarms) {
+    if (alarms > 100000) alarms = 100000;
+    Stamp* stamps = (Stamp*)malloc(sizeof(Stamp) * alarms);
+    uint64_t* latency = (uint64_t*)malloc(sizeof(uint64_t) * alarms);
+    if (!stamps || !latency) exit(1);
+
+    per_producer = alarms;
+    q = aq_create_ex(queue_type);
+    pthread_t t;
+    pthread_create(&t, NULL, alarm_consumer, latency);
+
+    struct timespec gap = { 0, 50000 };
+    for (long i = 0; i < alarms; i++) {
+        nanosleep(&gap, NULL);
+        stamps[i].sent_ns = now_ns();
+        while (aq_send(q, &stamps[i], AQ_ALARM) == AQ_NO_ROOM) {
+            sched_yield(); // The lock-free library refuses a second alarm instead of waiting
+            stamps[i].sent_ns = now_ns();
+        }
+    }
+    pthread_join(t, NULL);
+    aq_destroy(q);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    double cpu_ms = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-3;
+
+    qsort(latency, alarms, sizeof(uint64_t), cmp_u64);
+    printf("alarms\tp50_ns\tp99_ns\tmax_ns\tcpu_ms\n");
+    printf("%ld\t%lu\t%lu\t%lu\t%.0f\n", alarms, latency[alarms / 2], latency[(size_t)(alarms * 0.99)],
+           latency[alarms - 1], cpu_ms);
+    free(stamps);
+    free(latency);
+}
+
+int main(int argc, char** argv) {
+    long messages = 1000000;
+    int max_threads = 32;
+    int measure_latency = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:sSb:l")) != -1) {
+        switch (opt) {
+            case 'n': messages = strtol(optarg, NULL, 10); break;
+            case 't': max_threads = atoi(optarg); break;
+            case 's': queue_type = AQ_SPSC; max_threads = 1; break;
+            case 'S': queue_type = AQ_SHARDED; break;
+            case 'b': batch = atoi(optarg); break;
+            case 'l': measure_latency = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n messages] [-t max_threads] [-s] [-S] [-b batch] [-l]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (measure_latency) {
+        alarm_latency(messages);
+        return 0;
+    }
+
+    payload = (Msg*)malloc(sizeof(Msg) * messages);
+    if (!payload) return 1;
+
+    printf("producers\tconsumers\tmessages\tmsgs_per_sec\n");
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double rate = run(threads, messages);
+        printf("%d\t%d\t%ld\t%.0f\n", threads, threads, per_producer * threads, rate);
+        fflush(stdout);
+    }
+    free(payload);
+    return 0;
+}
@@ -57,5 +57,25 @@ int main(int argc, char ** argv) {
   /* Next get should give error */
   assert( get(q) == AQ_NO_MSG );
 
+  /* Batches: the alarm comes first, then the normal messages in order */
+  int * batch[3];
+  for (int i = 0; i < 3; i++) {
+    batch[i] = malloc(sizeof(int));
+    *batch[i] = 10 + i;
+  }
+  assert( aq_send_batch(q, (void * *) batch, 3) == 3 );
+  put_alarm (q, 13);
+
+  void * out[4];
+  MsgKind kinds[4];
+  assert( aq_recv_batch(q, out, 4, kinds) == 4 );
+  assert( kinds[0] == AQ_ALARM && *(int *) out[0] == 13 );
+  for (int i = 1; i < 4; i++) {
+    assert( kinds[i] == AQ_NORMAL && *(int *) out[i] == 9 + i );
+  }
+  for (int i = 0; i < 4; i++) free(out[i]);
+
+  assert( aq_recv_batch(q, out, 4, kinds) == AQ_NO_MSG );
+
   return 0;
 }
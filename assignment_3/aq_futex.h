@@ -0,0 +1,38 @@
+#ifndef AQ_FUTEX_H_INCLUDED
+#define AQ_FUTEX_H_INCLUDED
+
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// Futex wait and wake for receivers that park on a 32-bit event word, and
+// the pause instruction for the polling before they park.
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield" ::: "memory");
+#endif
+}
+
+// Sleeps while *word equals seen, until woken or until the CLOCK_MONOTONIC
+// deadline (for ever if NULL). Gives 0 if woken, otherwise ETIMEDOUT, EAGAIN
+// (word had already changed) or EINTR.
+static inline int futex_wait(atomic_uint* word, unsigned seen, const struct timespec* deadline) {
+    if (syscall(SYS_futex, word, FUTEX_WAIT_BITSET_PRIVATE, seen, deadline, NULL, FUTEX_BITSET_MATCH_ANY) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+// Wakes up to n threads sleeping on word and gives the number woken
+static inline int futex_wake(atomic_uint* word, int n) {
+    return (int)syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+#endif /* AQ_FUTEX_H_INCLUDED */
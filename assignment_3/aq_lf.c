@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "aq.h"
+#include "aq_time.h"
+
+// Lock-free variant of the alarm queue. Normal messages go through a bounded
+// multi-producer/multi-consumer ring where every cell carries a sequence
+// number telling whether it is ready for the next producer or consumer, so
+// sends and receives only need one compare-and-swap on a shared position.
+// The alarm is an atomic pointer slot. The mutex and condition variable are
+// only used by consumers that find the queue empty and producers that see
+// such a sleeping consumer.
+
+typedef struct {
+    int value;
+    MsgKind kind;
+} Msg;
+
+#define CAPACITY   65536   // Number of cells in the ring, a power of two
+#define CACHE_LINE 64
+
+typedef struct {
+    atomic_size_t seq;    // Position the cell is ready for
+    Msg* msg;
+} Cell;
+
+typedef struct {
+    _Alignas(CACHE_LINE) atomic_size_t tail;      // Next position to send to
+    _Alignas(CACHE_LINE) atomic_size_t head;      // Next position to receive from
+    _Alignas(CACHE_LINE) _Atomic(Msg*) alarm_msg; // The single alarm message (if any)
+    atomic_int sleepers;      // Number of consumers waiting on cond
+    pthread_mutex_t mutex;    // Only taken to sleep and to wake sleepers
+    pthread_cond_t cond;
+    Cell* cells;
+} AlarmQueueStruct;
+
+AlarmQueue aq_create() {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aligned_alloc(CACHE_LINE, sizeof(AlarmQueueStruct));
+    if (!queue) return NULL;
+
+    queue->cells = (Cell*)malloc(sizeof(Cell) * CAPACITY);
+    if (!queue->cells) {
+        free(queue);
+        return NULL;
+    }
+    for (size_t i = 0; i < CAPACITY; i++) {
+        atomic_init(&queue->cells[i].seq, i);
+    }
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->alarm_msg, NULL);
+    atomic_init(&queue->sleepers, 0);
+
+    pthread_mutex_init(&queue->mutex, NULL);
+    monotonic_cond_init(&queue->cond);
+
+    return (AlarmQueue)queue;
+}
+
+AlarmQueue aq_create_ex(int type) {
+    if (type == AQ_PRIO) return NULL; // Only the alarm slot and one ring here
+    return aq_create(); // The MPMC ring also serves a single producer and consumer
+}
+
+static int enqueue(AlarmQueueStruct* queue, Msg* msg) {
+    size_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    for (;;) {
+        Cell* cell = &queue->cells[pos & (CAPACITY - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            // Cell is free for this position; claim it
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->msg = msg;
+                atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return AQ_NO_ROOM; // The cell still holds a message from one lap ago
+        } else {
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+}
+
+static Msg* dequeue(AlarmQueueStruct* queue) {
+    size_t pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    for (;;) {
+        Cell* cell = &queue->cells[pos & (CAPACITY - 1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            // Cell holds the message for this position; claim it
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                Msg* msg = cell->msg;
+                atomic_store_explicit(&cell->seq, pos + CAPACITY, memory_order_release);
+                return msg;
+            }
+        } else if (diff < 0) {
+            return NULL; // Nothing sent to this position yet
+        } else {
+            pos = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+}
+
+// Takes the alarm if there is one, otherwise the oldest normal message
+static int try_recv(AlarmQueueStruct* queue, void** msg) {
+    if (atomic_load_explicit(&queue->alarm_msg, memory_order_relaxed)) {
+        Msg* alarm = atomic_exchange(&queue->alarm_msg, NULL);
+        if (alarm) {
+            *msg = alarm;
+            return AQ_ALARM;
+        }
+    }
+    Msg* normal = dequeue(queue);
+    if (normal) {
+        *msg = normal;
+        return AQ_NORMAL;
+    }
+    return AQ_NO_MSG;
+}
+
+// Wakes a sleeping consumer. The fence pairs with the one in aq_recv: either
+// the consumer sees the new message, or we see it counted in sleepers.
+static void wake(AlarmQueueStruct* queue) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&queue->sleepers, memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&queue->mutex);
+        pthread_cond_signal(&queue->cond);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+}
+
+int aq_send(AlarmQueue aq, void* msg, MsgKind kind) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (!queue) return AQ_UNINIT;
+    if (!msg) return AQ_NULL_MSG;
+
+    if (kind == AQ_ALARM) {
+        Msg* expected = NULL;
+        if (!atomic_compare_exchange_strong(&queue->alarm_msg, &expected, (Msg*)msg)) {
+            return AQ_NO_ROOM; // Cannot send another alarm message
+        }
+    } else {
+        int ret = enqueue(queue, (Msg*)msg);
+        if (ret < 0) return ret;
+    }
+
+    wake(queue);
+    return 0; // Message sent successfully
+}
+
+// Receives the alarm or the oldest normal message. If the queue is empty it
+// returns AQ_NO_MSG when wait is 0, and otherwise waits until deadline, or
+// for ever if deadline is NULL.
+static int recv_until(AlarmQueueStruct* queue, void** msg, int wait, const struct timespec* deadline) {
+    if (!queue) return AQ_UNINIT;
+
+    int ret = try_recv(queue, msg);
+    if (ret != AQ_NO_MSG || !wait) return ret;
+
+    // Queue is empty: register as a sleeper and check again before waiting
+    pthread_mutex_lock(&queue->mutex);
+    atomic_fetch_add(&queue->sleepers, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    while ((ret = try_recv(queue, msg)) == AQ_NO_MSG) {
+        if (!deadline) {
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+        } else if (pthread_cond_timedwait(&queue->cond, &queue->mutex, deadline) == ETIMEDOUT) {
+            ret = try_recv(queue, msg);
+            break;
+        }
+    }
+    atomic_fetch_sub(&queue->sleepers, 1);
+    pthread_mutex_unlock(&queue->mutex);
+    return ret;
+}
+
+int aq_recv(AlarmQueue aq, void** msg) {
+    return recv_until((AlarmQueueStruct*)aq, msg, 1, NULL);
+}
+
+int aq_try_recv(AlarmQueue aq, void** msg) {
+    return recv_until((AlarmQueueStruct*)aq, msg, 0, NULL);
+}
+
+int aq_recv_timed(AlarmQueue aq, void** msg, long long timeout_ns) {
+    struct timespec deadline = deadline_after(timeout_ns);
+    return recv_until((AlarmQueueStruct*)aq, msg, 1, &deadline);
+}
+
+int aq_send_batch(AlarmQueue aq, void** msgs, int n) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (!queue) return AQ_UNINIT;
+
+    int sent;
+    for (sent = 0; sent < n; sent++) {
+        int ret = msgs[sent] ? enqueue(queue, (Msg*)msgs[sent]) : AQ_NULL_MSG;
+        if (ret < 0) {
+            if (sent == 0) return ret;
+            break;
+        }
+    }
+
+    if (sent > 0) wake(queue); // One wakeup for the whole batch
+    return sent;
+}
+
+int aq_recv_batch(AlarmQueue aq, void** out, int max, MsgKind* kinds) {
+    if (max <= 0) return 0;
+
+    // Block for the first message only, then take what is there
+    int ret = aq_recv(aq, &out[0]);
+    if (ret < 0) return ret;
+    kinds[0] = ret;
+
+    int received = 1;
+    while (received < max && (ret = try_recv((AlarmQueueStruct*)aq, &out[received])) != AQ_NO_MSG) {
+        kinds[received++] = ret;
+    }
+    return received;
+}
+
+int aq_size(AlarmQueue aq) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    size_t head = atomic_load(&queue->head);
+    size_t tail = atomic_load(&queue->tail);
+    int size = tail > head ? (int)(tail - head) : 0; // Positions may be claimed but not yet filled
+    return size + (atomic_load(&queue->alarm_msg) != NULL);
+}
+
+int aq_alarms(AlarmQueue aq) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    return atomic_load(&queue->alarm_msg) != NULL;
+}
+
+int aq_count(AlarmQueue aq, MsgKind kind) {
+    if (kind == AQ_ALARM) return aq_alarms(aq);
+    if (kind == AQ_NORMAL) return aq_size(aq) - aq_alarms(aq);
+    return 0;
+}
+
+AlarmQueue aq_create_sharded(int shards) {
+    return aq_create(); // One queue stands in for all the shards
+}
+
+AlarmQueue aq_create_bounded(int type, int limit, int policy) {
+    return NULL; // Bounded queues are only in libaq.a
+}
+
+int aq_set_watermarks(AlarmQueue aq, int high, int low) {
+    return AQ_NOT_IMPL;
+}
+
+int aq_throttled(AlarmQueue aq) {
+    return 0;
+}
+
+int aq_dropped(AlarmQueue aq) {
+    return 0;
+}
+
+int aq_fd(AlarmQueue aq) {
+    return AQ_NOT_IMPL; // Pollable fds are only in libaq.a
+}
+
+int aq_alarm_fd(AlarmQueue aq) {
+    return AQ_NOT_IMPL;
+}
+
+void aq_destroy(AlarmQueue aq) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    Msg* msg;
+    while ((msg = dequeue(queue))) {
+        free(msg);
+    }
+    free(atomic_load(&queue->alarm_msg));
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->cond);
+    free(queue->cells);
+    free(queue);
+}
@@ -0,0 +1,76 @@
+#ifndef AQ_POLLFD_H_INCLUDED
+#define AQ_POLLFD_H_INCLUDED
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "aq.h"
+
+// An eventfd kept readable while a queue has messages (or alarms), so that
+// the queue can be watched with epoll. It is only created when aq_fd or
+// aq_alarm_fd asks for it; until then senders just load fd and move on.
+//
+// A sender signals it after queueing a message, but only writes to it when
+// it is not signalled already. A receiver that finds the queue empty resets
+// it, and must then look at the queue once more: a sender may have seen it
+// still signalled and skipped the write.
+
+typedef struct {
+    atomic_int fd;            // The eventfd, or -1 until asked for
+    atomic_int signalled;     // Set while the eventfd holds a count
+} PollFd;
+
+static inline void pollfd_init(PollFd* p) {
+    atomic_init(&p->fd, -1);
+    atomic_init(&p->signalled, 0);
+}
+
+// Gives the eventfd, creating it on the first call. The caller must then
+// signal it if the queue already has messages.
+static inline int pollfd_open(PollFd* p) {
+    int fd = atomic_load(&p->fd);
+    if (fd >= 0) return fd;
+
+    int new_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (new_fd < 0) return AQ_NO_ROOM;
+    if (!atomic_compare_exchange_strong(&p->fd, &fd, new_fd)) {
+        close(new_fd); // Another thread created it first
+        return fd;
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    return new_fd;
+}
+
+// Makes the eventfd readable. Must come after a full fence following the
+// send, or run under the lock the queue opens and resets the fd under, so
+// that either we see the fd or its opener sees the message.
+static inline void pollfd_signal(PollFd* p) {
+    int fd = atomic_load_explicit(&p->fd, memory_order_relaxed);
+    if (fd < 0 || atomic_load_explicit(&p->signalled, memory_order_relaxed)) return;
+    if (!atomic_exchange(&p->signalled, 1)) {
+        uint64_t one = 1;
+        ssize_t ret = write(fd, &one, sizeof(one));
+        (void)ret; // Cannot fail short of the counter overflowing
+    }
+}
+
+// Empties the eventfd. Gives 1 if it was signalled, in which case the caller
+// must look at the queue again and signal it if a message has arrived.
+static inline int pollfd_reset(PollFd* p) {
+    if (!atomic_load_explicit(&p->signalled, memory_order_relaxed)) return 0;
+
+    uint64_t count;
+    ssize_t ret = read(atomic_load(&p->fd), &count, sizeof(count));
+    (void)ret; // EAGAIN if a racing receiver emptied it first
+    atomic_store(&p->signalled, 0);
+    atomic_thread_fence(memory_order_seq_cst);
+    return 1;
+}
+
+static inline void pollfd_close(PollFd* p) {
+    int fd = atomic_load(&p->fd);
+    if (fd >= 0) close(fd);
+}
+
+#endif /* AQ_POLLFD_H_INCLUDED */
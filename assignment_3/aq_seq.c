@@ -15,9 +15,10 @@ typedef struct {
 } Msg;
 
 typedef struct {
-    Msg** messages;       // Dynamic array of pointers to normal messages
+    Msg** messages;       // Ring buffer of pointers to normal messages
     Msg* alarm_msg;       // Pointer to the single alarm message (if any)
-    int capacity;         // Maximum number of normal messages
+    int capacity;         // Size of the ring buffer
+    int head;             // Index of the oldest normal message
     int count;            // Current count of normal messages
     int alarm_present;    // Indicator if an alarm is in the queue (0 or 1)
 } AlarmQueueStruct;
@@ -34,6 +35,7 @@ AlarmQueue aq_create() {
         return NULL;
     }
     queue->capacity = INITIAL_CAPACITY;
+    queue->head = 0;
     queue->count = 0;
     queue->alarm_present = 0;
     queue->alarm_msg = NULL;
@@ -41,6 +43,27 @@ AlarmQueue aq_create() {
     return (AlarmQueue)queue;
 }
 
+AlarmQueue aq_create_ex(int type) {
+    if (type == AQ_PRIO) return NULL; // Only the alarm slot and one ring here
+    return aq_create(); // With no concurrency the other queue types behave the same
+}
+
+// Doubles the ring buffer, copying the messages to the start of the new one in FIFO order
+static int grow(AlarmQueueStruct* queue) {
+    int new_capacity = queue->capacity * 2;
+    Msg** new_messages = (Msg**)malloc(new_capacity * sizeof(Msg*));
+    if (!new_messages) return AQ_NO_ROOM;
+
+    for (int i = 0; i < queue->count; i++) {
+        new_messages[i] = queue->messages[(queue->head + i) % queue->capacity];
+    }
+    free(queue->messages);
+    queue->messages = new_messages;
+    queue->capacity = new_capacity;
+    queue->head = 0;
+    return 0;
+}
+
 int aq_send(AlarmQueue aq, void* msg, MsgKind kind) {
     AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
 
@@ -52,17 +75,10 @@ int aq_send(AlarmQueue aq, void* msg, MsgKind kind) {
         queue->alarm_present = 1;
     } else {
         // Handle normal message
-        if (queue->count >= queue->capacity) {
-            // Double the size of the messages array
-            int new_capacity = queue->capacity * 2;
-            Msg** new_messages = (Msg**)realloc(queue->messages, new_capacity * sizeof(Msg*));
-            if (!new_messages) {
-                return AQ_NO_ROOM; // Reallocation failed
-            }
-            queue->messages = new_messages;
-            queue->capacity = new_capacity;
+        if (queue->count >= queue->capacity && grow(queue) < 0) {
+            return AQ_NO_ROOM; // Reallocation failed
         }
-        queue->messages[queue->count++] = (Msg*)msg;
+        queue->messages[(queue->head + queue->count++) % queue->capacity] = (Msg*)msg;
     }
     return 0; // Message sent successfully
 }
@@ -77,11 +93,9 @@ int aq_recv(AlarmQueue aq, void** msg) {
         queue->alarm_present = 0;
         return AQ_ALARM; // Indicate that an alarm message was received
     } else if (queue->count > 0) {
-        // Return the next normal message
-        *msg = queue->messages[0];
-        for (int i = 1; i < queue->count; i++) {
-            queue->messages[i - 1] = queue->messages[i]; // Shift messages left
-        }
+        // Return the oldest normal message
+        *msg = queue->messages[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
         queue->count--;
         return AQ_NORMAL; // Indicate that a normal message was received
     }
@@ -89,6 +103,34 @@ int aq_recv(AlarmQueue aq, void** msg) {
     return AQ_NO_MSG; // No messages available
 }
 
+// Without other threads nothing can arrive while waiting, so these never wait
+int aq_try_recv(AlarmQueue aq, void** msg) {
+    return aq_recv(aq, msg);
+}
+
+int aq_recv_timed(AlarmQueue aq, void** msg, long long timeout_ns) {
+    return aq_recv(aq, msg);
+}
+
+int aq_send_batch(AlarmQueue aq, void** msgs, int n) {
+    int sent;
+    for (sent = 0; sent < n; sent++) {
+        int ret = aq_send(aq, msgs[sent], AQ_NORMAL);
+        if (ret < 0) return sent > 0 ? sent : ret;
+    }
+    return sent;
+}
+
+int aq_recv_batch(AlarmQueue aq, void** out, int max, MsgKind* kinds) {
+    int received = 0;
+    while (received < max) {
+        int ret = aq_recv(aq, &out[received]);
+        if (ret < 0) break;
+        kinds[received++] = ret;
+    }
+    return received > 0 ? received : AQ_NO_MSG;
+}
+
 int aq_size(AlarmQueue aq) {
     AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
     return queue->count + queue->alarm_present; // Total messages
@@ -99,10 +141,45 @@ int aq_alarms(AlarmQueue aq) {
     return queue->alarm_present; // 0 or 1
 }
 
+int aq_count(AlarmQueue aq, MsgKind kind) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (kind == AQ_ALARM) return queue->alarm_present;
+    if (kind == AQ_NORMAL) return queue->count;
+    return 0;
+}
+
+AlarmQueue aq_create_sharded(int shards) {
+    return aq_create(); // One queue stands in for all the shards
+}
+
+AlarmQueue aq_create_bounded(int type, int limit, int policy) {
+    return NULL; // Bounded queues are only in libaq.a
+}
+
+int aq_set_watermarks(AlarmQueue aq, int high, int low) {
+    return AQ_NOT_IMPL;
+}
+
+int aq_throttled(AlarmQueue aq) {
+    return 0;
+}
+
+int aq_dropped(AlarmQueue aq) {
+    return 0;
+}
+
+int aq_fd(AlarmQueue aq) {
+    return AQ_NOT_IMPL; // Pollable fds are only in libaq.a
+}
+
+int aq_alarm_fd(AlarmQueue aq) {
+    return AQ_NOT_IMPL;
+}
+
 void aq_destroy(AlarmQueue aq) {
     AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
     for (int i = 0; i < queue->count; i++) {
-        free(queue->messages[i]); // Free normal messages
+        free(queue->messages[(queue->head + i) % queue->capacity]); // Free normal messages
     }
     free(queue->messages);
     free(queue);
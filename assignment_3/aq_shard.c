@@ -0,0 +1,402 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "aq_shard.h"
+#include "aq_futex.h"
+#include "aq_pollfd.h"
+
+// Queue split into shards, each a ring with its own mutex, so that threads
+// working on different shards do not contend. Every sending thread is placed
+// round-robin on one shard and sends all its normal messages there; every
+// receiving thread likewise has a home shard. A receiver whose home shard is
+// empty steals the older half of another shard's messages (at most
+// STEAL_MAX), keeps the first and moves the rest to its home shard. The
+// single alarm bypasses the shards in an atomic slot that receivers check
+// first, so it is not stuck behind normal messages in some shard.
+//
+// Messages from one sender are received in the order sent as long as there
+// is a single receiver; with several receivers there is no global order.
+
+typedef struct {
+    int value;
+    MsgKind kind;
+} Msg;
+
+#define CACHE_LINE       64
+#define MAX_SHARDS       64
+#define STEAL_MAX        32      // Most messages moved by one steal
+#define INITIAL_CAPACITY 16
+#define SPIN_LIMIT       1000    // Polls of the shard counts before a receiver parks
+
+typedef struct {
+    _Alignas(CACHE_LINE) pthread_mutex_t mutex;
+    atomic_int count;         // Messages in the ring; read without the mutex to skip empty shards
+    int capacity;             // Size of the ring buffer
+    int head;                 // Index of the oldest message
+    Msg** messages;           // Ring buffer of pointers to messages
+} Shard;
+
+typedef struct {
+    int type;                 // AQ_SHARDED
+    int nshards;
+    int spin;                 // Times a receiver polls before parking
+
+    _Alignas(CACHE_LINE) _Atomic(Msg*) alarm_msg; // The single alarm message (if any)
+    pthread_mutex_t alarm_mutex;    // Only taken by senders waiting for the alarm slot and to wake them
+    pthread_cond_t alarm_cond;
+
+    // Receivers park on event. A sender only touches it when sleepers exceeds
+    // pending, the number of wakeups already on their way.
+    _Alignas(CACHE_LINE) atomic_uint event;
+    atomic_int sleepers;
+    atomic_int pending;
+
+    PollFd readable;          // Readable while there are messages
+    PollFd alarm_ready;       // Readable while there is an alarm
+
+    Shard shards[];
+} ShardedQueue;
+
+static atomic_uint senders;         // Threads placed so far, for round-robin placement
+static atomic_uint receivers;
+static _Thread_local int send_slot = -1;
+static _Thread_local int recv_slot = -1;
+
+// Gives the calling thread's slot, taking the next one on its first call
+static int slot(int* mine, atomic_uint* next) {
+    if (*mine < 0) {
+        *mine = (int)(atomic_fetch_add(next, 1) % MAX_SHARDS);
+    }
+    return *mine;
+}
+
+AlarmQueue shard_create(int shards) {
+    if (shards <= 0) shards = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (shards < 1) shards = 1;
+    if (shards > MAX_SHARDS) shards = MAX_SHARDS;
+
+    ShardedQueue* queue = (ShardedQueue*)aligned_alloc(CACHE_LINE, sizeof(ShardedQueue) + sizeof(Shard) * shards);
+    if (!queue) return NULL;
+
+    queue->type = AQ_SHARDED;
+    queue->nshards = shards;
+    queue->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_LIMIT : 0;
+    atomic_init(&queue->alarm_msg, NULL);
+    pthread_mutex_init(&queue->alarm_mutex, NULL);
+    pthread_cond_init(&queue->alarm_cond, NULL);
+    atomic_init(&queue->event, 0);
+    atomic_init(&queue->sleepers, 0);
+    atomic_init(&queue->pending, 0);
+    pollfd_init(&queue->readable);
+    pollfd_init(&queue->alarm_ready);
+
+    // Rings are allocated on their first message
+    for (int i = 0; i < shards; i++) {
+        Shard* shard = &queue->shards[i];
+        pthread_mutex_init(&shard->mutex, NULL);
+        atomic_init(&shard->count, 0);
+        shard->capacity = 0;
+        shard->head = 0;
+        shard->messages = NULL;
+    }
+
+    return (AlarmQueue)queue;
+}
+
+// Doubles the ring buffer, copying the messages to the start of the new one in FIFO order
+static int grow(Shard* shard) {
+    int count = atomic_load_explicit(&shard->count, memory_order_relaxed);
+    int new_capacity = shard->capacity ? shard->capacity * 2 : INITIAL_CAPACITY;
+    Msg** new_messages = (Msg**)malloc(sizeof(Msg*) * new_capacity);
+    if (!new_messages) return -1;
+
+    for (int i = 0; i < count; i++) {
+        new_messages[i] = shard->messages[(shard->head + i) % shard->capacity];
+    }
+    free(shard->messages);
+    shard->messages = new_messages;
+    shard->capacity = new_capacity;
+    shard->head = 0;
+    return 0;
+}
+
+// Appends msg to the shard, whose mutex must be held
+static int push(Shard* shard, Msg* msg) {
+    int count = atomic_load_explicit(&shard->count, memory_order_relaxed);
+    if (count >= shard->capacity && grow(shard) < 0) {
+        return AQ_NO_ROOM; // Reallocation failed
+    }
+    shard->messages[(shard->head + count) % shard->capacity] = msg;
+    atomic_store_explicit(&shard->count, count + 1, memory_order_relaxed);
+    return 0;
+}
+
+// Removes the oldest message of the shard, whose mutex must be held and which must not be empty
+static Msg* pop(Shard* shard) {
+    Msg* msg = shard->messages[shard->head];
+    shard->head = (shard->head + 1) % shard->capacity;
+    atomic_fetch_sub_explicit(&shard->count, 1, memory_order_relaxed);
+    return msg;
+}
+
+// Wakes one parked receiver, unless there is none or every parked receiver
+// already has a wakeup on its way. The fence pairs with the one in
+// recv_until: either the receiver sees the new message, or we see it in
+// sleepers. A wakeup that found nobody parked is taken back at once; one
+// that woke a receiver is taken back by that receiver.
+static void wake(ShardedQueue* queue) {
+    atomic_thread_fence(memory_order_seq_cst);
+    int sleepers = atomic_load_explicit(&queue->sleepers, memory_order_relaxed);
+    int pending = atomic_load_explicit(&queue->pending, memory_order_relaxed);
+    while (sleepers > pending) {
+        if (atomic_compare_exchange_weak(&queue->pending, &pending, pending + 1)) {
+            atomic_fetch_add(&queue->event, 1);
+            if (futex_wake(&queue->event, 1) == 0) {
+                atomic_fetch_sub(&queue->pending, 1);
+            }
+            return;
+        }
+        sleepers = atomic_load_explicit(&queue->sleepers, memory_order_relaxed);
+    }
+}
+
+static int has_messages(ShardedQueue* queue) {
+    if (atomic_load_explicit(&queue->alarm_msg, memory_order_relaxed)) return 1;
+    for (int i = 0; i < queue->nshards; i++) {
+        if (atomic_load_explicit(&queue->shards[i].count, memory_order_relaxed) > 0) return 1;
+    }
+    return 0;
+}
+
+int shard_send(AlarmQueue aq, void* msg, MsgKind kind) {
+    ShardedQueue* queue = (ShardedQueue*)aq;
+    if (!msg) return AQ_NULL_MSG;
+
+    if (kind == AQ_ALARM) {
+        // A second alarm waits until the first is received
+        pthread_mutex_lock(&queue->alarm_mutex);
+        Msg* expected = NULL;
+        while (!atomic_compare_exchange_strong(&queue->alarm_msg, &expected, (Msg*)msg)) {
+            pthread_cond_wait(&queue->alarm_cond, &queue->alarm_mutex);
+            expected = NULL;
+        }
+        pthread_mutex_unlock(&queue->alarm_mutex);
+    } else {
+        Shard* shard = &queue->shards[slot(&send_slot, &senders) % queue->nshards];
+        pthread_mutex_lock(&shard->mutex);
+        int ret = push(shard, (Msg*)msg);
+        pthread_mutex_unlock(&shard->mutex);
+        if (ret < 0) return ret;
+    }
+
+    wake(queue);
+    pollfd_signal(&queue->readable); // After the fence in wake
+    if (kind == AQ_ALARM) pollfd_signal(&queue->alarm_ready);
+    return 0;
+}
+
+// Takes the alarm; the sender of a second alarm may be waiting for the slot
+static Msg* take_alarm(ShardedQueue* queue) {
+    if (!atomic_load_explicit(&queue->alarm_msg, memory_order_relaxed)) return NULL;
+    Msg* alarm = atomic_exchange(&queue->alarm_msg, NULL);
+    if (alarm) {
+        pthread_mutex_lock(&queue->alarm_mutex);
+        pthread_cond_signal(&queue->alarm_cond);
+        pthread_mutex_unlock(&queue->alarm_mutex);
+    }
+    return alarm;
+}
+
+// Takes up to max messages from the shard. Wakes another receiver if some
+// are left, so that it can steal them.
+static int take(ShardedQueue* queue, Shard* shard, void** out, int max) {
+    if (atomic_load_explicit(&shard->count, memory_order_relaxed) == 0) return 0;
+
+    pthread_mutex_lock(&shard->mutex);
+    int n = 0;
+    while (n < max && atomic_load_explicit(&shard->count, memory_order_relaxed) > 0) {
+        out[n++] = pop(shard);
+    }
+    int left = atomic_load_explicit(&shard->count, memory_order_relaxed);
+    pthread_mutex_unlock(&shard->mutex);
+
+    if (left > 0) wake(queue);
+    return n;
+}
+
+// Moves the older half of the victim's messages (at most STEAL_MAX) to the
+// home shard and gives the first of them in msg. Both mutexes are taken in
+// shard order so two receivers stealing from each other cannot deadlock.
+static int steal(ShardedQueue* queue, Shard* home, Shard* victim, void** msg) {
+    if (atomic_load_explicit(&victim->count, memory_order_relaxed) == 0) return 0;
+
+    Shard* first = home < victim ? home : victim;
+    Shard* second = home < victim ? victim : home;
+    pthread_mutex_lock(&first->mutex);
+    pthread_mutex_lock(&second->mutex);
+
+    int count = atomic_load_explicit(&victim->count, memory_order_relaxed);
+    int n = (count + 1) / 2;
+    if (n > STEAL_MAX) n = STEAL_MAX;
+    if (n > 0) {
+        *msg = pop(victim);
+        for (int i = 1; i < n && push(home, victim->messages[victim->head]) == 0; i++) {
+            pop(victim);
+        }
+    }
+    int left = atomic_load_explicit(&home->count, memory_order_relaxed);
+
+    pthread_mutex_unlock(&second->mutex);
+    pthread_mutex_unlock(&first->mutex);
+
+    if (left > 0) wake(queue);
+    return n > 0;
+}
+
+// Resets the pollable fds when the queue was found without an alarm, and
+// also without messages if empty is set. A sender may have seen them still
+// signalled and skipped signalling, so look again after the reset.
+static void reset_fds(ShardedQueue* queue, int empty) {
+    if (pollfd_reset(&queue->alarm_ready) && atomic_load(&queue->alarm_msg)) {
+        pollfd_signal(&queue->alarm_ready);
+    }
+    if (empty && pollfd_reset(&queue->readable) && has_messages(queue)) {
+        pollfd_signal(&queue->readable);
+    }
+}
+
+// Takes the alarm if there is one, otherwise a message from the home shard,
+// otherwise steals from the other shards in turn
+static int try_recv(ShardedQueue* queue, void** msg) {
+    Msg* alarm = take_alarm(queue);
+    if (alarm) {
+        *msg = alarm;
+        return AQ_ALARM;
+    }
+
+    int home = slot(&recv_slot, &receivers) % queue->nshards;
+    int found = take(queue, &queue->shards[home], msg, 1);
+    for (int i = 1; !found && i < queue->nshards; i++) {
+        Shard* victim = &queue->shards[(home + i) % queue->nshards];
+        found = steal(queue, &queue->shards[home], victim, msg);
+    }
+    reset_fds(queue, !found);
+    return found ? AQ_NORMAL : AQ_NO_MSG;
+}
+
+// Receives the alarm or a normal message. If the queue is empty it returns
+// AQ_NO_MSG when wait is 0, and otherwise polls for a while and then parks
+// until deadline, or for ever if deadline is NULL.
+int shard_recv(AlarmQueue aq, void** msg, int wait, const struct timespec* deadline) {
+    ShardedQueue* queue = (ShardedQueue*)aq;
+    int ret;
+
+    while ((ret = try_recv(queue, msg)) == AQ_NO_MSG && wait) {
+        for (int i = 0; i < queue->spin && !has_messages(queue); i++) {
+            cpu_relax();
+        }
+        if (has_messages(queue)) continue;
+
+        // Register as a sleeper and look once more before parking
+        atomic_fetch_add(&queue->sleepers, 1);
+        unsigned seen = atomic_load(&queue->event);
+        atomic_thread_fence(memory_order_seq_cst);
+        int err = has_messages(queue) ? EAGAIN : futex_wait(&queue->event, seen, deadline);
+        atomic_fetch_sub(&queue->sleepers, 1);
+        if (err == 0) {
+            atomic_fetch_sub(&queue->pending, 1); // The wakeup was for us
+        } else if (err == ETIMEDOUT) {
+            return try_recv(queue, msg);
+        }
+    }
+    return ret;
+}
+
+int shard_send_batch(AlarmQueue aq, void** msgs, int n) {
+    ShardedQueue* queue = (ShardedQueue*)aq;
+    Shard* shard = &queue->shards[slot(&send_slot, &senders) % queue->nshards];
+
+    pthread_mutex_lock(&shard->mutex);
+    int sent;
+    for (sent = 0; sent < n; sent++) {
+        if (!msgs[sent] || push(shard, (Msg*)msgs[sent]) < 0) break;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+
+    if (sent > 0) {
+        wake(queue); // One wakeup for the whole batch; the receiver passes it on
+        pollfd_signal(&queue->readable);
+    }
+    if (sent == 0 && n > 0) return msgs[0] ? AQ_NO_ROOM : AQ_NULL_MSG;
+    return sent;
+}
+
+int shard_recv_batch(AlarmQueue aq, void** out, int max, MsgKind* kinds) {
+    ShardedQueue* queue = (ShardedQueue*)aq;
+    if (max <= 0) return 0;
+
+    // Block for the first message only, then take what the home shard holds
+    int ret = shard_recv(aq, &out[0], 1, NULL);
+    if (ret < 0) return ret;
+    kinds[0] = ret;
+
+    Shard* home = &queue->shards[slot(&recv_slot, &receivers) % queue->nshards];
+    int received = 1 + take(queue, home, &out[1], max - 1);
+    for (int i = 1; i < received; i++) {
+        kinds[i] = AQ_NORMAL;
+    }
+    return received;
+}
+
+int shard_size(AlarmQueue aq) {
+    ShardedQueue* queue = (ShardedQueue*)aq;
+    int size = atomic_load(&queue->alarm_msg) != NULL;
+    for (int i = 0; i < queue->nshards; i++) {
+        size += atomic_load(&queue->shards[i].count);
+    }
+    return size;
+}
+
+int shard_alarms(AlarmQueue aq) {
+    ShardedQueue* queue = (ShardedQueue*)aq;
+    return atomic_load(&queue->alarm_msg) != NULL;
+}
+
+int shard_count(AlarmQueue aq, MsgKind kind) {
+    if (kind == AQ_ALARM) return shard_alarms(aq);
+    if (kind == AQ_NORMAL) return shard_size(aq) - shard_alarms(aq);
+    return 0;
+}
+
+// Opens the fd that is readable while there are messages, or an alarm if
+// alarms is set. The fence in pollfd_open pairs with the one in wake.
+int shard_fd(AlarmQueue aq, int alarms) {
+    ShardedQueue* queue = (ShardedQueue*)aq;
+    PollFd* p = alarms ? &queue->alarm_ready : &queue->readable;
+    int fd = pollfd_open(p);
+    if (fd >= 0 && (alarms ? shard_alarms(aq) : has_messages(queue))) {
+        pollfd_signal(p);
+    }
+    return fd;
+}
+
+void shard_destroy(AlarmQueue aq) {
+    ShardedQueue* queue = (ShardedQueue*)aq;
+    for (int i = 0; i < queue->nshards; i++) {
+        Shard* shard = &queue->shards[i];
+        while (atomic_load(&shard->count) > 0) {
+            free(pop(shard));
+        }
+        free(shard->messages);
+        pthread_mutex_destroy(&shard->mutex);
+    }
+    free(atomic_load(&queue->alarm_msg));
+    pthread_mutex_destroy(&queue->alarm_mutex);
+    pthread_cond_destroy(&queue->alarm_cond);
+    pollfd_close(&queue->readable);
+    pollfd_close(&queue->alarm_ready);
+    free(queue);
+}
@@ -0,0 +1,21 @@
+#ifndef AQ_SHARD_H_INCLUDED
+#define AQ_SHARD_H_INCLUDED
+
+#include <time.h>
+#include "aq.h"
+
+// Sharded queue used by aq_tsafe.c for aq_create_ex(AQ_SHARDED) and
+// aq_create_sharded. Like the SPSC queue its struct starts with its type.
+
+AlarmQueue shard_create(int shards);
+int shard_send(AlarmQueue aq, void* msg, MsgKind kind);
+int shard_recv(AlarmQueue aq, void** msg, int wait, const struct timespec* deadline);
+int shard_send_batch(AlarmQueue aq, void** msgs, int n);
+int shard_recv_batch(AlarmQueue aq, void** out, int max, MsgKind* kinds);
+int shard_size(AlarmQueue aq);
+int shard_alarms(AlarmQueue aq);
+int shard_count(AlarmQueue aq, MsgKind kind);
+int shard_fd(AlarmQueue aq, int alarms);
+void shard_destroy(AlarmQueue aq);
+
+#endif /* AQ_SHARD_H_INCLUDED */
@@ -0,0 +1,256 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "aq_spsc.h"
+#include "aq_pollfd.h"
+#include "aq_time.h"
+
+// Wait-free ring for one producer and one consumer. The producer owns tail
+// and the consumer owns head; each keeps a cached copy of the other's index
+// on its own cache line and only reloads it when the ring looks full or
+// empty, so in the common case neither side touches a line the other writes.
+// The alarm is an atomic pointer slot that the consumer checks first. Only a
+// consumer finding the queue empty, or a producer with an undelivered alarm,
+// takes the mutex to sleep.
+
+typedef struct {
+    int value;
+    MsgKind kind;
+} Msg;
+
+#define CAPACITY   65536   // Number of cells in the ring, a power of two
+#define CACHE_LINE 64
+
+typedef struct {
+    int type;                 // AQ_SPSC
+
+    // Written by the producer
+    _Alignas(CACHE_LINE) atomic_size_t tail;    // Next position to send to
+    size_t head_cache;                          // Last head seen by the producer
+
+    // Written by the consumer
+    _Alignas(CACHE_LINE) atomic_size_t head;    // Next position to receive from
+    size_t tail_cache;                          // Last tail seen by the consumer
+
+    _Alignas(CACHE_LINE) _Atomic(Msg*) alarm_msg; // The single alarm message (if any)
+    atomic_int sleepers;      // Threads waiting on cond (the consumer, or the producer of an alarm)
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    PollFd readable;          // Readable while there are messages
+    PollFd alarm_ready;       // Readable while there is an alarm
+    Msg** messages;
+} SpscQueue;
+
+AlarmQueue spsc_create(void) {
+    SpscQueue* queue = (SpscQueue*)aligned_alloc(CACHE_LINE, sizeof(SpscQueue));
+    if (!queue) return NULL;
+
+    queue->messages = (Msg**)malloc(sizeof(Msg*) * CAPACITY);
+    if (!queue->messages) {
+        free(queue);
+        return NULL;
+    }
+    queue->type = AQ_SPSC;
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->head, 0);
+    queue->head_cache = 0;
+    queue->tail_cache = 0;
+    atomic_init(&queue->alarm_msg, NULL);
+    atomic_init(&queue->sleepers, 0);
+    pollfd_init(&queue->readable);
+    pollfd_init(&queue->alarm_ready);
+
+    pthread_mutex_init(&queue->mutex, NULL);
+    monotonic_cond_init(&queue->cond);
+
+    return (AlarmQueue)queue;
+}
+
+// Wakes the other side if it sleeps. The fence pairs with the one taken after
+// registering as a sleeper: either the sleeper sees our change, or we see it
+// counted in sleepers.
+static void wake(SpscQueue* queue) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&queue->sleepers, memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&queue->mutex);
+        pthread_cond_broadcast(&queue->cond);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+}
+
+static int try_recv(SpscQueue* queue, void** msg) {
+    if (atomic_load_explicit(&queue->alarm_msg, memory_order_acquire)) {
+        *msg = atomic_exchange(&queue->alarm_msg, NULL);
+        return AQ_ALARM;
+    }
+
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    if (head == queue->tail_cache) {
+        queue->tail_cache = atomic_load_explicit(&queue->tail, memory_order_acquire);
+        if (head == queue->tail_cache) return AQ_NO_MSG;
+    }
+    *msg = queue->messages[head & (CAPACITY - 1)];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return AQ_NORMAL;
+}
+
+int spsc_send(AlarmQueue aq, void* msg, MsgKind kind) {
+    SpscQueue* queue = (SpscQueue*)aq;
+
+    if (kind == AQ_ALARM) {
+        if (atomic_load_explicit(&queue->alarm_msg, memory_order_relaxed)) {
+            // Wait until the consumer has taken the previous alarm, as aq_tsafe.c does
+            pthread_mutex_lock(&queue->mutex);
+            atomic_fetch_add(&queue->sleepers, 1);
+            atomic_thread_fence(memory_order_seq_cst);
+            while (atomic_load(&queue->alarm_msg)) {
+                pthread_cond_wait(&queue->cond, &queue->mutex);
+            }
+            atomic_fetch_sub(&queue->sleepers, 1);
+            pthread_mutex_unlock(&queue->mutex);
+        }
+        atomic_store_explicit(&queue->alarm_msg, (Msg*)msg, memory_order_release);
+    } else {
+        size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        if (tail - queue->head_cache == CAPACITY) {
+            queue->head_cache = atomic_load_explicit(&queue->head, memory_order_acquire);
+            if (tail - queue->head_cache == CAPACITY) return AQ_NO_ROOM;
+        }
+        queue->messages[tail & (CAPACITY - 1)] = (Msg*)msg;
+        atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    }
+
+    wake(queue);
+    pollfd_signal(&queue->readable); // After the fence in wake
+    if (kind == AQ_ALARM) pollfd_signal(&queue->alarm_ready);
+    return 0; // Message sent successfully
+}
+
+// Resets the pollable fds when the queue was found without an alarm, and
+// also without messages if empty is set. The producer may have seen them
+// still signalled and skipped signalling, so look again after the reset.
+static void reset_fds(SpscQueue* queue, int empty) {
+    if (pollfd_reset(&queue->alarm_ready) && spsc_alarms(queue)) {
+        pollfd_signal(&queue->alarm_ready);
+    }
+    if (empty && pollfd_reset(&queue->readable) && spsc_size(queue) > 0) {
+        pollfd_signal(&queue->readable);
+    }
+}
+
+// Receives like recv_until in aq_tsafe.c: if the queue is empty it returns
+// AQ_NO_MSG when wait is 0, and otherwise waits until deadline (for ever if NULL)
+int spsc_recv(AlarmQueue aq, void** msg, int wait, const struct timespec* deadline) {
+    SpscQueue* queue = (SpscQueue*)aq;
+
+    int ret = try_recv(queue, msg);
+    if (ret == AQ_NO_MSG && wait) {
+        // Queue is empty: register as a sleeper and check again before waiting
+        pthread_mutex_lock(&queue->mutex);
+        atomic_fetch_add(&queue->sleepers, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        while ((ret = try_recv(queue, msg)) == AQ_NO_MSG) {
+            if (!deadline) {
+                pthread_cond_wait(&queue->cond, &queue->mutex);
+            } else if (pthread_cond_timedwait(&queue->cond, &queue->mutex, deadline) == ETIMEDOUT) {
+                ret = try_recv(queue, msg);
+                break;
+            }
+        }
+        atomic_fetch_sub(&queue->sleepers, 1);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+    if (ret == AQ_ALARM) {
+        wake(queue); // The producer may wait to send the next alarm
+    } else {
+        reset_fds(queue, ret == AQ_NO_MSG);
+    }
+    return ret;
+}
+
+int spsc_send_batch(AlarmQueue aq, void** msgs, int n) {
+    SpscQueue* queue = (SpscQueue*)aq;
+
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    if (tail - queue->head_cache + n > CAPACITY) {
+        queue->head_cache = atomic_load_explicit(&queue->head, memory_order_acquire);
+    }
+    size_t room = CAPACITY - (tail - queue->head_cache);
+    int sent = (size_t)n < room ? n : (int)room;
+    if (sent == 0) return n > 0 ? AQ_NO_ROOM : 0;
+
+    for (int i = 0; i < sent; i++) {
+        queue->messages[(tail + i) & (CAPACITY - 1)] = (Msg*)msgs[i];
+    }
+    atomic_store_explicit(&queue->tail, tail + sent, memory_order_release); // Publish them all at once
+
+    wake(queue);
+    pollfd_signal(&queue->readable);
+    return sent;
+}
+
+int spsc_recv_batch(AlarmQueue aq, void** out, int max, MsgKind* kinds) {
+    SpscQueue* queue = (SpscQueue*)aq;
+    if (max <= 0) return 0;
+
+    // Block for the first message only, which is the alarm if there is one
+    int ret = spsc_recv(aq, &out[0], 1, NULL);
+    kinds[0] = ret;
+
+    int received = 1;
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    queue->tail_cache = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    while (received < max && head != queue->tail_cache) {
+        out[received] = queue->messages[head++ & (CAPACITY - 1)];
+        kinds[received++] = AQ_NORMAL;
+    }
+    atomic_store_explicit(&queue->head, head, memory_order_release);
+    return received;
+}
+
+int spsc_size(AlarmQueue aq) {
+    SpscQueue* queue = (SpscQueue*)aq;
+    size_t head = atomic_load(&queue->head);
+    size_t tail = atomic_load(&queue->tail);
+    return (int)(tail - head) + (atomic_load(&queue->alarm_msg) != NULL);
+}
+
+int spsc_alarms(AlarmQueue aq) {
+    SpscQueue* queue = (SpscQueue*)aq;
+    return atomic_load(&queue->alarm_msg) != NULL;
+}
+
+int spsc_count(AlarmQueue aq, MsgKind kind) {
+    if (kind == AQ_ALARM) return spsc_alarms(aq);
+    if (kind == AQ_NORMAL) return spsc_size(aq) - spsc_alarms(aq);
+    return 0;
+}
+
+// Opens the fd that is readable while there are messages, or an alarm if
+// alarms is set. The fence in pollfd_open pairs with the one in wake.
+int spsc_fd(AlarmQueue aq, int alarms) {
+    SpscQueue* queue = (SpscQueue*)aq;
+    PollFd* p = alarms ? &queue->alarm_ready : &queue->readable;
+    int fd = pollfd_open(p);
+    if (fd >= 0 && (alarms ? spsc_alarms(aq) : spsc_size(aq)) > 0) {
+        pollfd_signal(p);
+    }
+    return fd;
+}
+
+void spsc_destroy(AlarmQueue aq) {
+    SpscQueue* queue = (SpscQueue*)aq;
+    size_t tail = atomic_load(&queue->tail);
+    for (size_t i = atomic_load(&queue->head); i != tail; i++) {
+        free(queue->messages[i & (CAPACITY - 1)]);
+    }
+    free(atomic_load(&queue->alarm_msg));
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->cond);
+    pollfd_close(&queue->readable);
+    pollfd_close(&queue->alarm_ready);
+    free(queue->messages);
+    free(queue);
+}
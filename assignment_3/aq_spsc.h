@@ -0,0 +1,22 @@
+#ifndef AQ_SPSC_H_INCLUDED
+#define AQ_SPSC_H_INCLUDED
+
+#include <time.h>
+#include "aq.h"
+
+// Single-producer/single-consumer queue used by aq_tsafe.c for
+// aq_create_ex(AQ_SPSC). Every queue struct of the library starts with its
+// type, so the aq_* functions can tell which implementation to call.
+
+AlarmQueue spsc_create(void);
+int spsc_send(AlarmQueue aq, void* msg, MsgKind kind);
+int spsc_recv(AlarmQueue aq, void** msg, int wait, const struct timespec* deadline);
+int spsc_send_batch(AlarmQueue aq, void** msgs, int n);
+int spsc_recv_batch(AlarmQueue aq, void** out, int max, MsgKind* kinds);
+int spsc_size(AlarmQueue aq);
+int spsc_alarms(AlarmQueue aq);
+int spsc_count(AlarmQueue aq, MsgKind kind);
+int spsc_fd(AlarmQueue aq, int alarms);
+void spsc_destroy(AlarmQueue aq);
+
+#endif /* AQ_SPSC_H_INCLUDED */
@@ -0,0 +1,33 @@
+#ifndef AQ_TIME_H_INCLUDED
+#define AQ_TIME_H_INCLUDED
+
+#include <time.h>
+#include <pthread.h>
+
+// Helpers for the timed receive of the thread-safe libraries. Receivers wait
+// on condition variables that use CLOCK_MONOTONIC, so timeouts are not
+// affected by changes of the wall clock.
+
+static inline void monotonic_cond_init(pthread_cond_t* cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// Gives the CLOCK_MONOTONIC time timeout_ns nanoseconds from now
+static inline struct timespec deadline_after(long long timeout_ns) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if (timeout_ns < 0) timeout_ns = 0;
+    deadline.tv_sec += timeout_ns / 1000000000;
+    deadline.tv_nsec += timeout_ns % 1000000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+#endif /* AQ_TIME_H_INCLUDED */
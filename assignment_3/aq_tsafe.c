@@ -1,7 +1,14 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
+#include <stdatomic.h>
 #include <pthread.h>
 #include "aq.h"
+#include "aq_futex.h"
+#include "aq_pollfd.h"
+#include "aq_shard.h"
+#include "aq_spsc.h"
+#include "aq_time.h"
 
 typedef struct {
     int value;
@@ -9,125 +16,491 @@ typedef struct {
 } Msg;
 
 typedef struct {
-    Msg** messages;       // Dynamic array of pointers to normal messages
-    Msg* alarm_msg;       // Pointer to the single alarm message (if any)
-    int capacity;         // Maximum number of normal messages
-    int count;            // Current count of normal messages
-    int alarm_present;    // Indicator if an alarm is in the queue (0 or 1)
+    Msg** messages;       // Ring buffer of pointers to messages
+    int capacity;         // Size of the ring buffer
+    int head;             // Index of the oldest message
+    int count;            // Current count of messages
+} Ring;
+
+typedef struct {
+    int type;             // AQ_MPMC or AQ_PRIO; AQ_SPSC and AQ_SHARDED queues live in aq_spsc.c and aq_shard.c
+    Ring levels[AQ_PRIORITIES];   // One FIFO per message kind
+    unsigned nonempty;    // Bit k is set when levels[k] holds messages
+    int count;            // Current count of messages of all kinds
+    int limit;            // Maximum number of normal messages, or 0 for no limit
+    int policy;           // What happens to a normal message sent at the limit
+    int high_water;       // Normal messages at which senders are throttled, or 0 for never
+    int low_water;        // Normal messages at which throttling stops again
+    int throttled;        // Indicator if the high watermark was passed (0 or 1)
+    int dropped;          // Messages dropped by AQ_DROP_OLDEST or AQ_DROP_NEWEST
+    int room_waiters;     // Senders waiting for room under AQ_BLOCK
     pthread_mutex_t mutex;    // Mutex for thread-safe access
-    pthread_cond_t cond;      // Condition variable for signaling
+    atomic_uint event;        // Futex word bumped by every send; empty-handed receivers wait on it
+    atomic_int sleepers;      // Receivers parked on event; each one adds and removes only itself
+    atomic_int pending;       // Wakeups sent to parked receivers that have not yet run
+    int spin;                 // Times a receiver polls event before parking
     pthread_cond_t alarm_cond;      // Condition variable for alarm signaling
+    pthread_cond_t room_cond;       // Condition variable for signaling room below the limit
+    PollFd readable;          // Readable while there are messages; signalled and reset under the mutex
+    PollFd alarm_ready;       // Readable while there are messages above AQ_NORMAL
 } AlarmQueueStruct;
 
 #define INITIAL_CAPACITY 4
+#define SPIN_LIMIT       1000   // Polls of about 10-40 ns each, so a receiver spins for some microseconds
 
-AlarmQueue aq_create() {
-    AlarmQueueStruct* queue = (AlarmQueueStruct*)malloc(sizeof(AlarmQueueStruct));
+static AlarmQueue create(int type, int limit, int policy) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)calloc(1, sizeof(AlarmQueueStruct));
     if (!queue) return NULL;
 
-    queue->messages = (Msg**)malloc(sizeof(Msg*) * INITIAL_CAPACITY);
-    if (!queue->messages) {
-        free(queue);
-        return NULL;
-    }
-    queue->capacity = INITIAL_CAPACITY;
-    queue->count = 0;
-    queue->alarm_present = 0;
-    queue->alarm_msg = NULL;
+    // Rings are allocated on their first message, since most queues use only a few kinds
+    queue->type = type;
+    queue->limit = limit;
+    queue->policy = policy;
+
+    // Spinning only helps if a sender can run at the same time
+    queue->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_LIMIT : 0;
 
     pthread_mutex_init(&queue->mutex, NULL);
-    pthread_cond_init(&queue->cond, NULL);
     pthread_cond_init(&queue->alarm_cond, NULL);
+    pthread_cond_init(&queue->room_cond, NULL);
+    pollfd_init(&queue->readable);
+    pollfd_init(&queue->alarm_ready);
 
     return (AlarmQueue)queue;
 }
 
+AlarmQueue aq_create() {
+    return create(AQ_MPMC, 0, AQ_BLOCK);
+}
+
+AlarmQueue aq_create_ex(int type) {
+    if (type == AQ_SPSC) return spsc_create();
+    if (type == AQ_SHARDED) return shard_create(0);
+    return create(type == AQ_PRIO ? AQ_PRIO : AQ_MPMC, 0, AQ_BLOCK);
+}
+
+AlarmQueue aq_create_sharded(int shards) {
+    return shard_create(shards);
+}
+
+AlarmQueue aq_create_bounded(int type, int limit, int policy) {
+    if (type == AQ_SPSC || type == AQ_SHARDED || limit <= 0) return NULL; // Only the mutex queue has limits
+    if (policy < AQ_BLOCK || policy > AQ_DROP_NEWEST) return NULL;
+    return create(type == AQ_PRIO ? AQ_PRIO : AQ_MPMC, limit, policy);
+}
+
+// Doubles the ring buffer, copying the messages to the start of the new one in FIFO order
+static int grow(Ring* ring) {
+    int new_capacity = ring->capacity ? ring->capacity * 2 : INITIAL_CAPACITY;
+    Msg** new_messages = (Msg**)malloc(new_capacity * sizeof(Msg*));
+    if (!new_messages) return AQ_NO_ROOM;
+
+    for (int i = 0; i < ring->count; i++) {
+        new_messages[i] = ring->messages[(ring->head + i) % ring->capacity];
+    }
+    free(ring->messages);
+    ring->messages = new_messages;
+    ring->capacity = new_capacity;
+    ring->head = 0;
+    return 0;
+}
+
+// Appends msg to the FIFO of its kind; the ring must have room
+static void push(AlarmQueueStruct* queue, Msg* msg, MsgKind kind) {
+    Ring* ring = &queue->levels[(int)kind];
+    ring->messages[(ring->head + ring->count++) % ring->capacity] = msg;
+    queue->nonempty |= 1u << kind;
+    queue->count++;
+}
+
+// Wakes up to n receivers after messages were queued. Bumping event makes a
+// receiver about to park return at once. Both atomics are sequentially
+// consistent, so either we see the receiver in sleepers or it sees the new
+// event. Only receivers without a wakeup on its way are woken, so until a
+// woken receiver has run, further sends skip the syscall. Wakeups that found
+// nobody parked are taken back at once; the others by the receivers woken.
+static void notify(AlarmQueueStruct* queue, int n) {
+    atomic_fetch_add(&queue->event, 1);
+    int pending = atomic_load(&queue->pending);
+    for (;;) {
+        int idle = atomic_load(&queue->sleepers) - pending;
+        if (idle <= 0) return;
+        int wake = idle < n ? idle : n;
+        if (atomic_compare_exchange_weak(&queue->pending, &pending, pending + wake)) {
+            int woken = futex_wake(&queue->event, wake);
+            if (woken < wake) {
+                atomic_fetch_sub(&queue->pending, wake - woken);
+            }
+            return;
+        }
+    }
+}
+
+// Receivers are woken one at a time. One that leaves messages behind wakes
+// the next, so a batch does not wake receivers that would find nothing.
+static void pass_on(AlarmQueueStruct* queue) {
+    if (queue->count > 0 && atomic_load(&queue->sleepers) > 0) {
+        notify(queue, 1);
+    }
+}
+
+// Waits for a send after the queue was found empty: polls for a while, then
+// parks on the futex until deadline (for ever if NULL). Called with the mutex
+// held and returns with it held; gives ETIMEDOUT on timeout, otherwise 0.
+static int wait_for_send(AlarmQueueStruct* queue, const struct timespec* deadline) {
+    unsigned seen = atomic_load(&queue->event);
+    pthread_mutex_unlock(&queue->mutex);
+
+    int err = 0;
+    for (int i = 0; i < queue->spin && atomic_load_explicit(&queue->event, memory_order_relaxed) == seen; i++) {
+        cpu_relax();
+    }
+    if (atomic_load(&queue->event) == seen) {
+        atomic_fetch_add(&queue->sleepers, 1);
+        err = futex_wait(&queue->event, seen, deadline);
+        atomic_fetch_sub(&queue->sleepers, 1);
+        if (err == 0) {
+            atomic_fetch_sub(&queue->pending, 1); // The wakeup was for us
+        }
+    }
+
+    pthread_mutex_lock(&queue->mutex);
+    return err == ETIMEDOUT ? ETIMEDOUT : 0;
+}
+
+// Removes the oldest message of the given kind; the ring must not be empty
+static Msg* take(AlarmQueueStruct* queue, MsgKind kind) {
+    Ring* ring = &queue->levels[(int)kind];
+    Msg* msg = ring->messages[ring->head];
+    ring->head = (ring->head + 1) % ring->capacity;
+    if (--ring->count == 0) {
+        queue->nonempty &= ~(1u << kind);
+    }
+    queue->count--;
+
+    if (kind == AQ_NORMAL) {
+        if (queue->throttled && ring->count <= queue->low_water) {
+            queue->throttled = 0;
+        }
+        if (queue->room_waiters) {
+            pthread_cond_signal(&queue->room_cond);
+        }
+    }
+    return msg;
+}
+
+// Removes the oldest message of the highest kind present; the queue must not be empty
+static MsgKind pop(AlarmQueueStruct* queue, void** msg) {
+    MsgKind kind = 31 - __builtin_clz(queue->nonempty);
+    *msg = take(queue, kind);
+    return kind;
+}
+
+// Queues a normal message, applying the overflow policy when the queue is at
+// its limit. Called with the mutex held.
+static int put_normal(AlarmQueueStruct* queue, Msg* msg) {
+    Ring* ring = &queue->levels[AQ_NORMAL];
+
+    if (queue->limit && ring->count >= queue->limit) {
+        switch (queue->policy) {
+            case AQ_FAIL:
+                return AQ_NO_ROOM;
+            case AQ_DROP_NEWEST:
+                free(msg);
+                queue->dropped++;
+                return AQ_DROPPED;
+            case AQ_DROP_OLDEST:
+                free(take(queue, AQ_NORMAL));
+                queue->dropped++;
+                break;
+            default:
+                // Wake receivers first, since messages of a batch may not have been signalled yet
+                notify(queue, INT_MAX);
+                queue->room_waiters++;
+                while (ring->count >= queue->limit) {
+                    pthread_cond_wait(&queue->room_cond, &queue->mutex); // Wait until there is room
+                }
+                queue->room_waiters--;
+        }
+    }
+
+    if (ring->count >= ring->capacity && grow(ring) < 0) {
+        return AQ_NO_ROOM; // Reallocation failed
+    }
+    push(queue, msg, AQ_NORMAL);
+    if (queue->high_water && ring->count >= queue->high_water) {
+        queue->throttled = 1;
+    }
+    return 0;
+}
+
 int aq_send(AlarmQueue aq, void* msg, MsgKind kind) {
     AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC) return spsc_send(aq, msg, kind);
+    if (queue->type == AQ_SHARDED) return shard_send(aq, msg, kind);
+
+    if (queue->type == AQ_PRIO) {
+        if (kind < 0 || kind >= AQ_PRIORITIES) return AQ_NOT_IMPL;
+    } else if (kind != AQ_ALARM) {
+        kind = AQ_NORMAL;
+    }
 
     pthread_mutex_lock(&queue->mutex);
 
-    if (kind == AQ_ALARM) {
-        while (queue->alarm_present) {
-            pthread_cond_wait(&queue->alarm_cond, &queue->mutex); // Wait until there’s a message
-        }
-        //if (queue->alarm_present) {
-        //    pthread_mutex_unlock(&queue->mutex);
-        //    return AQ_NO_ROOM; // Cannot send another alarm message
-        //}
-        queue->alarm_msg = (Msg*)msg;
-        queue->alarm_present = 1;
+    // Only an AQ_PRIO queue holds more than one alarm at a time
+    while (kind == AQ_ALARM && queue->type == AQ_MPMC && queue->levels[AQ_ALARM].count > 0) {
+        pthread_cond_wait(&queue->alarm_cond, &queue->mutex); // Wait until the alarm is received
+    }
+
+    int ret = 0;
+    if (kind == AQ_NORMAL) {
+        ret = put_normal(queue, (Msg*)msg);
     } else {
-        if (queue->count >= queue->capacity) {
-            int new_capacity = queue->capacity * 2;
-            Msg** new_messages = (Msg**)realloc(queue->messages, new_capacity * sizeof(Msg*));
-            if (!new_messages) {
-                pthread_mutex_unlock(&queue->mutex);
-                return AQ_NO_ROOM; // Reallocation failed
-            }
-            queue->messages = new_messages;
-            queue->capacity = new_capacity;
-            
+        Ring* ring = &queue->levels[(int)kind];
+        if (ring->count >= ring->capacity && grow(ring) < 0) {
+            ret = AQ_NO_ROOM; // Reallocation failed
+        } else {
+            push(queue, (Msg*)msg, kind);
         }
-        queue->messages[queue->count++] = (Msg*)msg;
+    }
+    int queued = ret == 0;
+    if (queued) {
+        pollfd_signal(&queue->readable);
+        if (kind != AQ_NORMAL) pollfd_signal(&queue->alarm_ready);
+    }
+    if (queued && queue->throttled) {
+        ret = AQ_THROTTLE; // Sent, but the sender should slow down
     }
 
-    pthread_cond_signal(&queue->cond); // Signal any waiting receivers
     pthread_mutex_unlock(&queue->mutex);
+    if (queued) {
+        notify(queue, 1); // Wake a waiting receiver
+    }
+
+    return ret;
+}
 
-    return 0; // Message sent successfully
+// Resets the pollable fds once the queue has no messages or no alarms left.
+// Called with the mutex held, so no sender can signal them meanwhile.
+static void reset_fds(AlarmQueueStruct* queue) {
+    if (queue->count == 0) pollfd_reset(&queue->readable);
+    if (queue->count == queue->levels[AQ_NORMAL].count) pollfd_reset(&queue->alarm_ready);
+}
+
+// Receives the oldest message of the highest kind. If the queue is empty it
+// returns AQ_NO_MSG when wait is 0, and otherwise waits until deadline, or
+// for ever if deadline is NULL.
+static int recv_until(AlarmQueueStruct* queue, void** msg, int wait, const struct timespec* deadline) {
+    pthread_mutex_lock(&queue->mutex);
+
+    while (queue->count == 0) {
+        int err = wait ? wait_for_send(queue, deadline) : ETIMEDOUT;
+        if (err == ETIMEDOUT && queue->count == 0) {
+            reset_fds(queue);
+            pthread_mutex_unlock(&queue->mutex);
+            return AQ_NO_MSG;
+        }
+    }
+
+    MsgKind kind = pop(queue, msg);
+    reset_fds(queue);
+    pass_on(queue);
+    pthread_mutex_unlock(&queue->mutex);
+    if (kind == AQ_ALARM) {
+        pthread_cond_signal(&queue->alarm_cond); // A sender may wait for the alarm slot
+    }
+    return kind;
 }
 
 int aq_recv(AlarmQueue aq, void** msg) {
     AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC) return spsc_recv(aq, msg, 1, NULL);
+    if (queue->type == AQ_SHARDED) return shard_recv(aq, msg, 1, NULL);
+    return recv_until(queue, msg, 1, NULL);
+}
+
+int aq_try_recv(AlarmQueue aq, void** msg) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC) return spsc_recv(aq, msg, 0, NULL);
+    if (queue->type == AQ_SHARDED) return shard_recv(aq, msg, 0, NULL);
+    return recv_until(queue, msg, 0, NULL);
+}
+
+int aq_recv_timed(AlarmQueue aq, void** msg, long long timeout_ns) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    struct timespec deadline = deadline_after(timeout_ns);
+    if (queue->type == AQ_SPSC) return spsc_recv(aq, msg, 1, &deadline);
+    if (queue->type == AQ_SHARDED) return shard_recv(aq, msg, 1, &deadline);
+    return recv_until(queue, msg, 1, &deadline);
+}
+
+int aq_send_batch(AlarmQueue aq, void** msgs, int n) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC) return spsc_send_batch(aq, msgs, n);
+    if (queue->type == AQ_SHARDED) return shard_send_batch(aq, msgs, n);
+
+    pthread_mutex_lock(&queue->mutex);
+
+    int sent, queued = 0;
+    for (sent = 0; sent < n; sent++) {
+        int ret = put_normal(queue, (Msg*)msgs[sent]);
+        if (ret < 0) break;
+        queued += ret == 0; // Not if dropped by AQ_DROP_NEWEST
+    }
+    if (queued > 0) {
+        pollfd_signal(&queue->readable);
+    }
+
+    pthread_mutex_unlock(&queue->mutex);
+    if (queued > 0) {
+        notify(queue, 1); // One wakeup for the whole batch; the receiver passes it on
+    }
+
+    return sent > 0 || n == 0 ? sent : AQ_NO_ROOM;
+}
+
+int aq_recv_batch(AlarmQueue aq, void** out, int max, MsgKind* kinds) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC) return spsc_recv_batch(aq, out, max, kinds);
+    if (queue->type == AQ_SHARDED) return shard_recv_batch(aq, out, max, kinds);
+    if (max <= 0) return 0;
 
     pthread_mutex_lock(&queue->mutex);
 
-    while (queue->count == 0 && !queue->alarm_present) {
-        pthread_cond_wait(&queue->cond, &queue->mutex); // Wait until there’s a message
+    while (queue->count == 0) {
+        wait_for_send(queue, NULL); // Wait until there’s a message
+    }
+
+    int received = 0;
+    int got_alarm = 0;
+    while (received < max && queue->count > 0) {
+        kinds[received] = pop(queue, &out[received]);
+        got_alarm |= kinds[received++] == AQ_ALARM;
     }
+    reset_fds(queue);
+    pass_on(queue);
 
-    if (queue->alarm_present) {
-        *msg = queue->alarm_msg;
-        queue->alarm_msg = NULL;
-        queue->alarm_present = 0;
-        pthread_mutex_unlock(&queue->mutex);
+    pthread_mutex_unlock(&queue->mutex);
+    if (got_alarm) {
         pthread_cond_signal(&queue->alarm_cond);
-        return AQ_ALARM; // Alarm message received
-    } else {
-        *msg = queue->messages[0];
-        for (int i = 1; i < queue->count; i++) {
-            queue->messages[i - 1] = queue->messages[i];
-        }
-        queue->count--;
-        pthread_mutex_unlock(&queue->mutex);
-        return AQ_NORMAL; // Normal message received
     }
+    return received;
 }
 
 int aq_size(AlarmQueue aq) {
     AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC) return spsc_size(aq);
+    if (queue->type == AQ_SHARDED) return shard_size(aq);
     pthread_mutex_lock(&queue->mutex);
-    int size = queue->count + queue->alarm_present;
+    int size = queue->count;
     pthread_mutex_unlock(&queue->mutex);
     return size;
 }
 
 int aq_alarms(AlarmQueue aq) {
     AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC) return spsc_alarms(aq);
+    if (queue->type == AQ_SHARDED) return shard_alarms(aq);
     pthread_mutex_lock(&queue->mutex);
-    int alarms = queue->alarm_present;
+    int alarms = queue->count - queue->levels[AQ_NORMAL].count;
     pthread_mutex_unlock(&queue->mutex);
     return alarms;
 }
 
+int aq_count(AlarmQueue aq, MsgKind kind) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC) return spsc_count(aq, kind);
+    if (queue->type == AQ_SHARDED) return shard_count(aq, kind);
+    if (kind < 0 || kind >= AQ_PRIORITIES) return 0;
+    pthread_mutex_lock(&queue->mutex);
+    int count = queue->levels[(int)kind].count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+int aq_set_watermarks(AlarmQueue aq, int high, int low) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC || queue->type == AQ_SHARDED) return AQ_NOT_IMPL;
+    if (high < 0) high = 0;
+    if (low >= high) low = high > 0 ? high - 1 : 0;
+    if (low < 0) low = 0;
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->high_water = high;
+    queue->low_water = low;
+    int normal = queue->levels[AQ_NORMAL].count;
+    queue->throttled = high > 0 && (normal >= high || (queue->throttled && normal > low));
+    pthread_mutex_unlock(&queue->mutex);
+    return 0;
+}
+
+int aq_throttled(AlarmQueue aq) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC || queue->type == AQ_SHARDED) return 0;
+    pthread_mutex_lock(&queue->mutex);
+    int throttled = queue->throttled;
+    pthread_mutex_unlock(&queue->mutex);
+    return throttled;
+}
+
+int aq_dropped(AlarmQueue aq) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC || queue->type == AQ_SHARDED) return 0;
+    pthread_mutex_lock(&queue->mutex);
+    int dropped = queue->dropped;
+    pthread_mutex_unlock(&queue->mutex);
+    return dropped;
+}
+
+// Opens the fd that is readable while there are messages, or alarms if
+// alarms is set, and signals it if there are some already
+static int open_fd(AlarmQueueStruct* queue, int alarms) {
+    PollFd* p = alarms ? &queue->alarm_ready : &queue->readable;
+    pthread_mutex_lock(&queue->mutex);
+    int fd = pollfd_open(p);
+    int ready = alarms ? queue->count > queue->levels[AQ_NORMAL].count : queue->count > 0;
+    if (fd >= 0 && ready) {
+        pollfd_signal(p);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    return fd;
+}
+
+int aq_fd(AlarmQueue aq) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC) return spsc_fd(aq, 0);
+    if (queue->type == AQ_SHARDED) return shard_fd(aq, 0);
+    return open_fd(queue, 0);
+}
+
+int aq_alarm_fd(AlarmQueue aq) {
+    AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC) return spsc_fd(aq, 1);
+    if (queue->type == AQ_SHARDED) return shard_fd(aq, 1);
+    return open_fd(queue, 1);
+}
+
 void aq_destroy(AlarmQueue aq) {
     AlarmQueueStruct* queue = (AlarmQueueStruct*)aq;
+    if (queue->type == AQ_SPSC) {
+        spsc_destroy(aq);
+        return;
+    }
+    if (queue->type == AQ_SHARDED) {
+        shard_destroy(aq);
+        return;
+    }
     pthread_mutex_destroy(&queue->mutex);
-    pthread_cond_destroy(&queue->cond);
-    for (int i = 0; i < queue->count; i++) {
-        free(queue->messages[i]);
+    pthread_cond_destroy(&queue->alarm_cond);
+    pthread_cond_destroy(&queue->room_cond);
+    pollfd_close(&queue->readable);
+    pollfd_close(&queue->alarm_ready);
+    for (int k = 0; k < AQ_PRIORITIES; k++) {
+        Ring* ring = &queue->levels[k];
+        for (int i = 0; i < ring->count; i++) {
+            free(ring->messages[(ring->head + i) % ring->capacity]);
+        }
+        free(ring->messages);
     }
-    free(queue->messages);
     free(queue);
 }
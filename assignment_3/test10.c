@@ -0,0 +1,73 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <assert.h>
+#include "aq.h"
+#include "aux.h"
+
+// SPSC queue: the alarm is received before the normal messages sent ahead
+// of it, the ring refuses the 65537th normal message, and a second alarm
+// waits until the first has been received.
+
+#define CAPACITY 65536
+
+typedef struct {
+    int value;
+} Msg;
+
+static Msg msgs[CAPACITY + 3];   // Not malloc'ed: the queue is drained before aq_destroy
+static AlarmQueue q;
+
+void *producer(void *arg) {
+    assert(aq_send(q, &msgs[1], AQ_ALARM) == 0);
+    assert(aq_send(q, &msgs[2], AQ_ALARM) == 0);   // Blocks until alarm 1 is received
+    return NULL;
+}
+
+int main() {
+    q = aq_create_ex(AQ_SPSC);
+    if (q == NULL) {
+        printf("Alarm queue could not be created\n");
+        return 1;
+    }
+    for (int i = 0; i < CAPACITY + 3; i++) msgs[i].value = i;
+
+    // Alarm first
+    void *msg;
+    assert(aq_send(q, &msgs[0], AQ_NORMAL) == 0);
+    assert(aq_send(q, &msgs[1], AQ_NORMAL) == 0);
+    assert(aq_send(q, &msgs[2], AQ_ALARM) == 0);
+    assert(aq_size(q) == 3 && aq_alarms(q) == 1);
+    assert(aq_recv(q, &msg) == AQ_ALARM && msg == &msgs[2]);
+    assert(aq_recv(q, &msg) == AQ_NORMAL && msg == &msgs[0]);
+    assert(aq_recv(q, &msg) == AQ_NORMAL && msg == &msgs[1]);
+    assert(aq_try_recv(q, &msg) == AQ_NO_MSG);
+    printf("Received the alarm before the normal messages\n");
+
+    // Full ring; an alarm still gets in
+    for (int i = 0; i < CAPACITY; i++) {
+        assert(aq_send(q, &msgs[i], AQ_NORMAL) == 0);
+    }
+    assert(aq_send(q, &msgs[CAPACITY], AQ_NORMAL) == AQ_NO_ROOM);
+    assert(aq_send(q, &msgs[CAPACITY], AQ_ALARM) == 0);
+    assert(aq_size(q) == CAPACITY + 1);
+    assert(aq_recv(q, &msg) == AQ_ALARM && msg == &msgs[CAPACITY]);
+    for (int i = 0; i < CAPACITY; i++) {
+        assert(aq_recv(q, &msg) == AQ_NORMAL && msg == &msgs[i]);
+    }
+    assert(aq_size(q) == 0);
+    printf("Received %d messages from the full ring\n", CAPACITY + 1);
+
+    // The second alarm waits for the first to be received
+    pthread_t t;
+    pthread_create(&t, NULL, producer, NULL);
+    msleep(100);
+    assert(aq_size(q) == 1);
+    assert(aq_recv(q, &msg) == AQ_ALARM && msg == &msgs[1]);
+    assert(aq_recv(q, &msg) == AQ_ALARM && msg == &msgs[2]);
+    pthread_join(t, NULL);
+    printf("Received the blocked alarm after the first\n");
+
+    aq_destroy(q);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include "aq.h"
+#include "aux.h"
+
+// Batches on the mutex and SPSC queues: aq_send_batch keeps the order of
+// its messages, aq_recv_batch gives a pending alarm first and then the
+// normal messages in order, and a batch larger than the room left in the
+// SPSC ring is sent in part.
+
+#define CAPACITY 65536
+
+typedef struct {
+    int value;
+} Msg;
+
+static Msg msgs[CAPACITY];   // Not malloc'ed: the queues are drained before aq_destroy
+static void *ptrs[CAPACITY];
+
+static void check_order(AlarmQueue q) {
+    void *out[20];
+    MsgKind kinds[20];
+
+    assert(aq_send_batch(q, ptrs, 0) == 0);
+    assert(aq_send_batch(q, ptrs, 10) == 10);
+    assert(aq_send(q, &msgs[10], AQ_ALARM) == 0);
+    assert(aq_size(q) == 11);
+
+    assert(aq_recv_batch(q, out, 4, kinds) == 4);
+    assert(kinds[0] == AQ_ALARM && out[0] == &msgs[10]);
+    for (int i = 1; i < 4; i++) {
+        assert(kinds[i] == AQ_NORMAL && out[i] == &msgs[i - 1]);
+    }
+    assert(aq_recv_batch(q, out, 20, kinds) == 7);
+    for (int i = 0; i < 7; i++) {
+        assert(kinds[i] == AQ_NORMAL && out[i] == &msgs[i + 3]);
+    }
+    assert(aq_size(q) == 0);
+}
+
+int main() {
+    for (int i = 0; i < CAPACITY; i++) {
+        msgs[i].value = i;
+        ptrs[i] = &msgs[i];
+    }
+
+    AlarmQueue q = aq_create();
+    check_order(q);
+    aq_destroy(q);
+    printf("Received batches in order from the mutex queue\n");
+
+    q = aq_create_ex(AQ_SPSC);
+    check_order(q);
+
+    // Only the room left in the ring is used
+    assert(aq_send_batch(q, ptrs, 100) == 100);
+    assert(aq_send_batch(q, ptrs, CAPACITY) == CAPACITY - 100);
+    assert(aq_send_batch(q, ptrs, 1) == AQ_NO_ROOM);
+    void *out[100];
+    MsgKind kinds[100];
+    assert(aq_recv_batch(q, out, 100, kinds) == 100);
+    for (int i = 0; i < 100; i++) assert(out[i] == &msgs[i]);
+    for (int n = 0; n < CAPACITY - 100; ) {
+        int got = aq_recv_batch(q, out, 100, kinds);
+        assert(got > 0);
+        for (int i = 0; i < got; i++) assert(out[i] == &msgs[n + i]);
+        n += got;
+    }
+    assert(aq_size(q) == 0);
+    aq_destroy(q);
+    printf("Received batches in order from the SPSC queue\n");
+
+    return 0;
+}
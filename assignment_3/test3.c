@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <assert.h>
+#include "aq.h"
+#include "aux.h"
+
+// Non-blocking and timed receive: an empty queue gives AQ_NO_MSG at once
+// or after the timeout, and a message sent while waiting is received.
+
+typedef struct {
+    int value;
+} Msg;
+
+static AlarmQueue q;
+
+static long elapsed_ms(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+void *producer(void *arg) {
+    msleep(300);
+    put_normal(q, 1);
+    put_alarm(q, 2);
+    return NULL;
+}
+
+int main() {
+    q = aq_create();
+    if (q == NULL) {
+        printf("Alarm queue could not be created\n");
+        return 1;
+    }
+
+    void *msg;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(aq_try_recv(q, &msg) == AQ_NO_MSG);
+    assert(aq_recv_timed(q, &msg, 100 * 1000000LL) == AQ_NO_MSG);
+    assert(elapsed_ms(&start) >= 100);
+
+    pthread_t t;
+    pthread_create(&t, NULL, producer, NULL);
+
+    // The first message arrives after about 300 ms, well within the timeout
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int kind = aq_recv_timed(q, &msg, 5000 * 1000000LL);
+    assert(kind >= 0 && elapsed_ms(&start) < 5000);
+    printf("Received %s message with value %d\n", kind == AQ_ALARM ? "ALARM " : "normal", ((Msg*)msg)->value);
+    free(msg);
+    pthread_join(t, NULL);
+
+    // The rest is already there, so a try gets it
+    kind = aq_try_recv(q, &msg);
+    assert(kind >= 0);
+    printf("Received %s message with value %d\n", kind == AQ_ALARM ? "ALARM " : "normal", ((Msg*)msg)->value);
+    free(msg);
+    assert(aq_try_recv(q, &msg) == AQ_NO_MSG);
+
+    aq_destroy(q);
+    return 0;
+}
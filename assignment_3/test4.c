@@ -0,0 +1,64 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <assert.h>
+#include "aq.h"
+#include "aux.h"
+
+// Priority queue: alarms no longer wait for each other, and messages are
+// received by kind, highest first, oldest first within a kind.
+
+typedef struct {
+    int value;
+} Msg;
+
+static AlarmQueue q;
+
+static void put(int val, MsgKind kind) {
+    Msg *m = malloc(sizeof(Msg));
+    m->value = val;
+    assert(aq_send(q, m, kind) == 0);
+    printf("Sent kind %d message with value %d\n", kind, val);
+}
+
+void *producer(void *arg) {
+    put(1, AQ_NORMAL);
+    put(2, AQ_ALARM);
+    put(3, AQ_ALARM);      // Does not block although alarm 2 is undelivered
+    put(4, 5);
+    put(5, AQ_NORMAL);
+    put(6, AQ_PRIORITIES - 1);
+    put(7, 5);
+    return NULL;
+}
+
+int main() {
+    q = aq_create_ex(AQ_PRIO);
+    if (q == NULL) {
+        printf("Alarm queue could not be created\n");
+        return 1;
+    }
+    assert(aq_send(q, &q, AQ_PRIORITIES) == AQ_NOT_IMPL);
+
+    pthread_t t;
+    pthread_create(&t, NULL, producer, NULL);
+    pthread_join(t, NULL);
+
+    assert(aq_size(q) == 7);
+    assert(aq_alarms(q) == 5);
+    assert(aq_count(q, AQ_NORMAL) == 2 && aq_count(q, AQ_ALARM) == 2);
+    assert(aq_count(q, 5) == 2 && aq_count(q, AQ_PRIORITIES - 1) == 1);
+
+    int expected[] = { 6, 4, 7, 2, 3, 1, 5 };
+    for (int i = 0; i < 7; i++) {
+        void *msg;
+        int kind = aq_recv(q, &msg);
+        printf("Received kind %d message with value %d\n", kind, ((Msg*)msg)->value);
+        assert(((Msg*)msg)->value == expected[i]);
+        free(msg);
+    }
+    assert(aq_size(q) == 0);
+
+    aq_destroy(q);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <assert.h>
+#include "aq.h"
+#include "aux.h"
+
+// Bounded queues: each overflow policy at the limit, and the watermarks
+// that throttle senders before the limit is reached.
+
+typedef struct {
+    int value;
+} Msg;
+
+static AlarmQueue q;
+
+static int put(int val, MsgKind kind) {
+    Msg *m = malloc(sizeof(Msg));
+    m->value = val;
+    int ret = aq_send(q, m, kind);
+    if (ret < 0) free(m);
+    return ret;
+}
+
+static int take(void) {
+    void *msg;
+    int kind = aq_recv(q, &msg);
+    assert(kind >= 0);
+    int val = ((Msg*)msg)->value;
+    printf("Received %s message with value %d\n", kind == AQ_ALARM ? "ALARM " : "normal", val);
+    free(msg);
+    return val;
+}
+
+void *producer(void *arg) {
+    for (int i = 1; i <= 6; i++) {
+        assert(put(i, AQ_NORMAL) == 0);   // Blocks from message 4 until the consumer takes one
+    }
+    return NULL;
+}
+
+int main() {
+    // AQ_FAIL: the fourth normal message is refused, but an alarm still gets in
+    q = aq_create_bounded(AQ_MPMC, 3, AQ_FAIL);
+    for (int i = 1; i <= 3; i++) assert(put(i, AQ_NORMAL) == 0);
+    assert(put(4, AQ_NORMAL) == AQ_NO_ROOM);
+    assert(put(5, AQ_ALARM) == 0);
+    assert(take() == 5 && take() == 1 && take() == 2 && take() == 3);
+    aq_destroy(q);
+
+    // AQ_DROP_OLDEST and AQ_DROP_NEWEST keep the newest and oldest three
+    q = aq_create_bounded(AQ_MPMC, 3, AQ_DROP_OLDEST);
+    for (int i = 1; i <= 5; i++) assert(put(i, AQ_NORMAL) == 0);
+    assert(aq_dropped(q) == 2 && aq_size(q) == 3);
+    assert(take() == 3 && take() == 4 && take() == 5);
+    aq_destroy(q);
+
+    q = aq_create_bounded(AQ_MPMC, 3, AQ_DROP_NEWEST);
+    for (int i = 1; i <= 5; i++) assert(put(i, AQ_NORMAL) == (i <= 3 ? 0 : AQ_DROPPED));
+    assert(aq_dropped(q) == 2 && aq_size(q) == 3);
+    assert(take() == 1 && take() == 2 && take() == 3);
+    aq_destroy(q);
+
+    // AQ_BLOCK: the producer waits for room and nothing is lost
+    q = aq_create_bounded(AQ_MPMC, 3, AQ_BLOCK);
+    pthread_t t;
+    pthread_create(&t, NULL, producer, NULL);
+    msleep(200);
+    assert(aq_size(q) == 3);
+    for (int i = 1; i <= 6; i++) assert(take() == i);
+    pthread_join(t, NULL);
+    aq_destroy(q);
+
+    // Watermarks: throttled from 4 queued messages until drained to 1
+    q = aq_create();
+    assert(aq_set_watermarks(q, 4, 1) == 0);
+    for (int i = 1; i <= 3; i++) assert(put(i, AQ_NORMAL) == 0);
+    assert(put(4, AQ_NORMAL) == AQ_THROTTLE && aq_throttled(q));
+    take();
+    take();
+    assert(aq_throttled(q) && put(5, AQ_NORMAL) == AQ_THROTTLE);
+    take();
+    take();
+    assert(!aq_throttled(q) && put(6, AQ_NORMAL) == 0);
+    aq_destroy(q);
+
+    return 0;
+}
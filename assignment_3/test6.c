@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <assert.h>
+#include "aq.h"
+#include "aux.h"
+
+// Sharded queue: each producer fills its own shard, so a lone consumer has
+// to steal. It gets the alarm first and every producer's messages in the
+// order sent. Then several consumers share the messages of several
+// producers, and none is lost.
+
+#define PRODUCERS 4
+#define MESSAGES  50
+
+typedef struct {
+    int value;
+} Msg;
+
+static AlarmQueue q;
+
+static void put(int val, MsgKind kind) {
+    Msg *m = malloc(sizeof(Msg));
+    m->value = val;
+    assert(aq_send(q, m, kind) == 0);
+}
+
+void *producer(void *arg) {
+    int p = (int)(intptr_t)arg;
+    for (int i = 0; i < MESSAGES; i++) {
+        put(p * 1000 + i, AQ_NORMAL);
+    }
+    return NULL;
+}
+
+void *consumer(void *arg) {
+    long received = 0;
+    void *msg;
+    while (aq_recv(q, &msg) >= 0 && ((Msg*)msg)->value >= 0) {
+        free(msg);
+        received++;
+    }
+    free(msg);
+    return (void *)received;
+}
+
+int main() {
+    assert(aq_create_bounded(AQ_SHARDED, 10, AQ_FAIL) == NULL);
+    q = aq_create_sharded(PRODUCERS);
+    if (q == NULL) {
+        printf("Alarm queue could not be created\n");
+        return 1;
+    }
+
+    pthread_t t[PRODUCERS];
+    for (intptr_t p = 0; p < PRODUCERS; p++) {
+        pthread_create(&t[p], NULL, producer, (void *)p);
+    }
+    for (int p = 0; p < PRODUCERS; p++) {
+        pthread_join(t[p], NULL);
+    }
+    put(-1, AQ_ALARM);
+    assert(aq_size(q) == PRODUCERS * MESSAGES + 1);
+    assert(aq_count(q, AQ_NORMAL) == PRODUCERS * MESSAGES && aq_alarms(q) == 1);
+
+    void *msg;
+    assert(aq_recv(q, &msg) == AQ_ALARM && ((Msg*)msg)->value == -1);
+    printf("Received ALARM message with value %d\n", ((Msg*)msg)->value);
+    free(msg);
+
+    int next[PRODUCERS] = { 0 };
+    for (int i = 0; i < PRODUCERS * MESSAGES; i++) {
+        assert(aq_recv(q, &msg) == AQ_NORMAL);
+        int val = ((Msg*)msg)->value;
+        assert(val % 1000 == next[val / 1000]++);
+        free(msg);
+    }
+    printf("Received %d normal messages in order\n", PRODUCERS * MESSAGES);
+    assert(aq_try_recv(q, &msg) == AQ_NO_MSG);
+
+    // Several consumers; each stops at the first message with a negative value
+    pthread_t c[PRODUCERS];
+    for (intptr_t p = 0; p < PRODUCERS; p++) {
+        pthread_create(&c[p], NULL, consumer, NULL);
+        pthread_create(&t[p], NULL, producer, (void *)p);
+    }
+    for (int p = 0; p < PRODUCERS; p++) {
+        pthread_join(t[p], NULL);
+    }
+    while (aq_size(q) > 0) {
+        msleep(1);
+    }
+    for (int p = 0; p < PRODUCERS; p++) {
+        put(-1, AQ_NORMAL);
+    }
+    long received = 0;
+    for (int p = 0; p < PRODUCERS; p++) {
+        void *n;
+        pthread_join(c[p], &n);
+        received += (long)n;
+    }
+    printf("Received %ld normal messages with %d consumers\n", received, PRODUCERS);
+    assert(received == PRODUCERS * MESSAGES);
+
+    aq_destroy(q);
+    return 0;
+}
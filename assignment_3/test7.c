@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <assert.h>
+#include "aq.h"
+#include "aux.h"
+
+// Pollable fds: one epoll loop serves a queue of each type. The fd of a
+// queue is readable while it holds messages and is reset once aq_try_recv
+// finds it empty; the alarm fd is readable while an alarm is pending.
+
+#define QUEUES   3
+#define MESSAGES 20
+
+typedef struct {
+    int value;
+} Msg;
+
+static AlarmQueue qs[QUEUES];
+
+static void put(AlarmQueue q, int val, MsgKind kind) {
+    Msg *m = malloc(sizeof(Msg));
+    m->value = val;
+    assert(aq_send(q, m, kind) == 0);
+}
+
+static int readable(int fd) {
+    struct pollfd p = { .fd = fd, .events = POLLIN };
+    return poll(&p, 1, 0) == 1;
+}
+
+void *producer(void *arg) {
+    AlarmQueue q = qs[(intptr_t)arg];
+    for (int i = 1; i <= MESSAGES; i++) {
+        put(q, i, i == MESSAGES / 2 ? AQ_ALARM : AQ_NORMAL);
+        if (i % 5 == 0) msleep(2);   // Let the loop find the queue empty now and then
+    }
+    return NULL;
+}
+
+int main() {
+    qs[0] = aq_create();
+    qs[1] = aq_create_ex(AQ_SPSC);
+    qs[2] = aq_create_sharded(2);
+
+    int ep = epoll_create1(0);
+    for (int i = 0; i < QUEUES; i++) {
+        assert(qs[i] != NULL);
+
+        // An fd opened on a queue with messages is readable at once
+        put(qs[i], 0, AQ_ALARM);
+        int fd = aq_fd(qs[i]), alarm_fd = aq_alarm_fd(qs[i]);
+        assert(fd >= 0 && alarm_fd >= 0 && aq_fd(qs[i]) == fd);
+        assert(readable(fd) && readable(alarm_fd));
+
+        void *msg;
+        assert(aq_try_recv(qs[i], &msg) == AQ_ALARM);
+        free(msg);
+        assert(aq_try_recv(qs[i], &msg) == AQ_NO_MSG);
+        assert(!readable(fd) && !readable(alarm_fd));
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.u32 = i };
+        epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    pthread_t t[QUEUES];
+    for (intptr_t i = 0; i < QUEUES; i++) {
+        pthread_create(&t[i], NULL, producer, (void *)i);
+    }
+
+    int received[QUEUES] = { 0 };
+    int total = 0;
+    while (total < QUEUES * MESSAGES) {
+        struct epoll_event evs[QUEUES];
+        int n = epoll_wait(ep, evs, QUEUES, 5000);
+        assert(n > 0);
+        for (int e = 0; e < n; e++) {
+            int i = evs[e].data.u32;
+            void *msg;
+            int kind;
+            while ((kind = aq_try_recv(qs[i], &msg)) != AQ_NO_MSG) {
+                assert(kind >= 0);
+                printf("Received %s message with value %d from queue %d\n",
+                       kind == AQ_ALARM ? "ALARM " : "normal", ((Msg*)msg)->value, i);
+                free(msg);
+                received[i]++;
+                total++;
+            }
+        }
+    }
+
+    for (int i = 0; i < QUEUES; i++) {
+        pthread_join(t[i], NULL);
+        assert(received[i] == MESSAGES);
+        assert(!readable(aq_fd(qs[i])) && !readable(aq_alarm_fd(qs[i])));
+        aq_destroy(qs[i]);
+    }
+    return 0;
+}
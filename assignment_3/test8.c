@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <assert.h>
+#include "aq.h"
+#include "aux.h"
+
+// Stress test for waking receivers: several receivers park on an empty
+// queue over and over while producers send small bursts with pauses in
+// between. A lost wakeup leaves a receiver parked with messages queued, and
+// the test then hangs instead of receiving every message.
+
+#define PRODUCERS 2
+#define CONSUMERS 4
+#define ROUNDS    3000
+
+typedef struct {
+    int value;
+} Msg;
+
+static AlarmQueue q;
+
+static void put(int val) {
+    Msg *m = malloc(sizeof(Msg));
+    m->value = val;
+    assert(aq_send(q, m, AQ_NORMAL) == 0);
+}
+
+void *producer(void *arg) {
+    long sent = 0;
+    for (int i = 0; i < ROUNDS; i++) {
+        for (int j = 0; j <= i % 4; j++) {
+            put(1);
+            sent++;
+        }
+        if (i % 8 == 0) msleep(1);   // Let the receivers drain the queue and park
+    }
+    return (void *)sent;
+}
+
+void *consumer(void *arg) {
+    long received = 0;
+    void *msg;
+    while (aq_recv(q, &msg) >= 0) {
+        int val = ((Msg*)msg)->value;
+        free(msg);
+        if (val < 0) break;
+        received++;
+    }
+    return (void *)received;
+}
+
+int main() {
+    q = aq_create();
+    if (q == NULL) {
+        printf("Alarm queue could not be created\n");
+        return 1;
+    }
+
+    pthread_t c[CONSUMERS], p[PRODUCERS];
+    for (int i = 0; i < CONSUMERS; i++) pthread_create(&c[i], NULL, consumer, NULL);
+    for (int i = 0; i < PRODUCERS; i++) pthread_create(&p[i], NULL, producer, NULL);
+
+    long sent = 0, received = 0;
+    for (int i = 0; i < PRODUCERS; i++) {
+        void *n;
+        pthread_join(p[i], &n);
+        sent += (long)n;
+    }
+    for (int i = 0; i < CONSUMERS; i++) put(-1);   // FIFO, so the stops come last
+    for (int i = 0; i < CONSUMERS; i++) {
+        void *n;
+        pthread_join(c[i], &n);
+        received += (long)n;
+    }
+
+    printf("Received %ld of %ld messages with %d receivers\n", received, sent, CONSUMERS);
+    assert(received == sent);
+    assert(aq_size(q) == 0);
+    aq_destroy(q);
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include "aq.h"
+#include "aux.h"
+
+// Lock-free library, built with: make TEST_FILE=test9.c TEST_LIB=aq_lf test
+// The ring holds 65536 normal messages and refuses more; the alarm slot
+// takes one alarm even when the ring is full, and refuses a second one.
+// Receiving gives the alarm first, then the ring in order, also after the
+// positions have wrapped around.
+
+#define CAPACITY 65536
+
+typedef struct {
+    int value;
+} Msg;
+
+static Msg msgs[CAPACITY + 2];   // Not malloc'ed: the queue is drained before aq_destroy
+
+int main() {
+    AlarmQueue q = aq_create();
+    if (q == NULL) {
+        printf("Alarm queue could not be created\n");
+        return 1;
+    }
+    for (int i = 0; i < CAPACITY + 2; i++) msgs[i].value = i;
+
+    void *msg;
+    assert(aq_try_recv(q, &msg) == AQ_NO_MSG);
+    assert(aq_send(q, NULL, AQ_NORMAL) == AQ_NULL_MSG);
+
+    for (int lap = 0; lap < 2; lap++) {
+        for (int i = 0; i < CAPACITY; i++) {
+            assert(aq_send(q, &msgs[i], AQ_NORMAL) == 0);
+        }
+        assert(aq_send(q, &msgs[CAPACITY], AQ_NORMAL) == AQ_NO_ROOM);
+        assert(aq_send(q, &msgs[CAPACITY], AQ_ALARM) == 0);
+        assert(aq_send(q, &msgs[CAPACITY + 1], AQ_ALARM) == AQ_NO_ROOM);
+        assert(aq_size(q) == CAPACITY + 1 && aq_alarms(q) == 1);
+
+        assert(aq_recv(q, &msg) == AQ_ALARM && msg == &msgs[CAPACITY]);
+        for (int i = 0; i < CAPACITY; i++) {
+            assert(aq_recv(q, &msg) == AQ_NORMAL && msg == &msgs[i]);
+        }
+        assert(aq_try_recv(q, &msg) == AQ_NO_MSG);
+        assert(aq_size(q) == 0);
+        printf("Received %d messages in lap %d\n", CAPACITY + 1, lap);
+    }
+
+    // A freed cell takes a message again
+    assert(aq_send(q, &msgs[0], AQ_NORMAL) == 0);
+    assert(aq_recv(q, &msg) == AQ_NORMAL && msg == &msgs[0]);
+
+    aq_destroy(q);
+    return 0;
+}